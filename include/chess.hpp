@@ -2186,6 +2186,23 @@ class Board {
         return ss;
     }
 
+    /// @brief Counts how often the current position occurred before, like
+    /// isRepetition but returning the count.
+    /// @param count stop counting at this many
+    /// @return
+    [[nodiscard]] int repetitionCount(int count = 2) const {
+        int c = 0;
+
+        for (int i = static_cast<int>(prev_states_.size()) - 2;
+             i >= 0 && i >= static_cast<int>(prev_states_.size()) - hfm_ - 1; i -= 2) {
+            if (prev_states_[i].hash == key_) c++;
+
+            if (c == count) break;
+        }
+
+        return c;
+    }
+
     /// @brief Checks if the current position is a repetition, set this to 1 if
     /// you are writing a chess engine.
     /// @param count
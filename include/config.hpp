@@ -30,6 +30,7 @@ public:
     }
 
     void config_params();
+    void tuned_params();
 
 private:
     std::map<std::string, std::string> configMap;
@@ -1,33 +1,78 @@
 #pragma once
 
+#include <array>
 #include <torch/script.h>
 #include "include/planes.hpp"
+#include "include/utils/bit_unpack.hpp"
 #include "include/search/node.hpp"
+#include "include/model/model.hpp"
 
+// longest position history the encoder supports
+constexpr uint8_t MAX_HISTORY = 8;
+constexpr int MAX_PLANES = planes::POSITION_PLANES * MAX_HISTORY + planes::EXTRA_PLANES;
+
+// Planes of the positions before the search root, newest first. Computed once per root instead of for every leaf.
+struct RootHistory {
+    std::array<Bitboard, planes::POSITION_PLANES * (MAX_HISTORY - 1)> planes = {};
+    uint8_t positions = 0;
+    void set(const std::vector<chess::Board>& traversed, const uint8_t history);
+};
+
+// Input planes of a position and its history, held inline so encoding a leaf allocates nothing
 struct EncodedState {
-    std::unique_ptr<Bitboard[]> encodedState;
-    EncodedState(const Node* node, const std::vector<chess::Board>& traversed, const uint8_t history);
-    inline torch::Tensor toTensor();
-    const uint8_t history;
-    uint8_t totalPlanes;
+    std::array<Bitboard, MAX_PLANES> encodedState;
+    EncodedState() = default;
+    EncodedState(chess::Board& board, const Node* node, const RootHistory& root_history, const uint8_t history);
+    inline void write(model::BatchBuffer& batch, const unsigned int index) const;
+    inline void write(uint16_t* slot, const uint16_t one) const;
+    inline void write(uint32_t* slot, const uint32_t one) const;
+    inline void write(int64_t* slot) const;
+    uint8_t history = 0;
+    uint8_t totalPlanes = 0;
+
+    // @return Number of input planes for a history length
+    static constexpr unsigned int planeCount(const uint8_t history) {
+        return planes::POSITION_PLANES * history + planes::EXTRA_PLANES;
+    }
+
+private:
+    template<uint8_t HISTORY>
+    void encode(chess::Board& board, const Node* node, const RootHistory& root_history);
 };
 
-// Function to convert a bitboard to a 2D tensor representation
-inline torch::Tensor EncodedState::toTensor() {
-    auto tensor = torch::zeros({totalPlanes, 8, 8}, torch::kHalf);
+/*
+    Unpacks the bitboards into a slot of a 16 bit batch input, every value of the slot is written
+    @param slot: first of the totalPlanes * 64 values of the slot
+    @param one: bit pattern of 1.0 in the input's format
+*/
+inline void EncodedState::write(uint16_t* slot, const uint16_t one) const {
+    // square i is row i / 8, column i % 8 of a plane
+    for (int board = 0; board < totalPlanes; ++board) {
+        bit_unpack::unpack64(encodedState[board].getBits(), slot + board * 64, one);
+    }
+}
+
+// Unpacks the bitboards into a slot of a 32 bit batch input.
+inline void EncodedState::write(uint32_t* slot, const uint32_t one) const {
+    for (int board = 0; board < totalPlanes; ++board) {
+        bit_unpack::unpack64(encodedState[board].getBits(), slot + board * 64, one);
+    }
+}
+
+/*
+    Copies the bitboards into a slot of a packed batch input, the network unpacks them
+    @param slot: first of the totalPlanes bitboards of the slot
+*/
+inline void EncodedState::write(int64_t* slot) const {
     for (int board = 0; board < totalPlanes; ++board) {
-        for (int i = 0; i < 64; ++i) {
-            // Check if the ith bit is set
-            if (encodedState[board] & (1ULL << i)) {
-                // Calculate row and column from bit position
-                int row = i / 8;
-                int col = i % 8;
-                
-                // Set the corresponding tensor element
-                tensor[board][row][col] = 1.0;
-            }
-        }
+        slot[board] = static_cast<int64_t>(encodedState[board].getBits());
     }
-    
-    return tensor;
+}
+
+// Writes the position into a slot of a batch in the batch's input format, values are written as their bit patterns.
+inline void EncodedState::write(model::BatchBuffer& batch, const unsigned int index) const {
+    if (batch.packed) write(batch.packedSlot(index));
+    else if (batch.input_type == torch::kFloat32) write(batch.slot<uint32_t>(index), bit_unpack::FLOAT_ONE);
+    else if (batch.input_type == torch::kBFloat16) write(batch.slot<uint16_t>(index), bit_unpack::BFLOAT16_ONE);
+    else write(batch.slot<uint16_t>(index), bit_unpack::HALF_ONE);
 }
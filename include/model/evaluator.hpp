@@ -0,0 +1,89 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include "include/model/model.hpp"
+#include "include/native/network.hpp"
+
+namespace model {
+
+    /*
+        Backend that searches evaluate their batches with. An executor pool clones one evaluator per
+        executor thread, so a clone is only ever used by one thread at a time while clones of the same
+        evaluator run concurrently.
+    */
+    class Evaluator {
+    public:
+        // releases the evaluator's executor pool, if it has one
+        virtual ~Evaluator();
+
+        // Writes the priors and values of the filled slots of a batch into its outputs.
+        virtual void evaluate(BatchBuffer& batch) = 0;
+
+        // @return An evaluator of its own for another executor, sharing this one's weights
+        virtual std::unique_ptr<Evaluator> clone() const = 0;
+
+        // @return Device batches are evaluated on, their buffers are pinned for it
+        virtual torch::Device device() const {
+            return torch::kCPU;
+        }
+
+        // @return Element type dense batch inputs must have
+        virtual torch::ScalarType inputType() const {
+            return torch::kFloat32;
+        }
+    };
+
+    // A TorchScript model, converted to its precision and optimized by main before it is wrapped.
+    class TorchEvaluator : public Evaluator {
+    public:
+        TorchEvaluator(const torch::jit::script::Module& module, const torch::Device device, const torch::ScalarType input_type);
+
+        void evaluate(BatchBuffer& batch) override;
+        std::unique_ptr<Evaluator> clone() const override;
+
+        torch::Device device() const override {
+            return model_device;
+        }
+
+        torch::ScalarType inputType() const override {
+            return input_type;
+        }
+
+    private:
+        torch::jit::script::Module module;
+        const torch::Device model_device;
+        const torch::ScalarType input_type;
+    };
+
+    // The libtorch free cpu network of include/native/network.hpp, fp32 only.
+    class NativeEvaluator : public Evaluator {
+    public:
+        explicit NativeEvaluator(std::shared_ptr<const native::Network> network);
+
+        void evaluate(BatchBuffer& batch) override;
+        std::unique_ptr<Evaluator> clone() const override;
+
+    private:
+        std::shared_ptr<const native::Network> network;
+        native::Workspace workspace;
+    };
+
+    /*
+        Deterministic stand in for the network, so the search, its threads and the transposition table
+        can be measured without a model. The value is the material balance of the side to move, the
+        priors are a fixed hash of the position and the move, and each batch takes an artificial
+        latency of batch_latency plus position_latency per position before its results are ready.
+    */
+    class MockEvaluator : public Evaluator {
+    public:
+        MockEvaluator(const std::chrono::microseconds batch_latency, const std::chrono::microseconds position_latency);
+
+        void evaluate(BatchBuffer& batch) override;
+        std::unique_ptr<Evaluator> clone() const override;
+
+    private:
+        const std::chrono::microseconds batch_latency;
+        const std::chrono::microseconds position_latency;
+    };
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <vector>
+#include "include/model/evaluator.hpp"
+
+namespace model {
+
+    // how many executors a model gets and how their threads run
+    struct ExecutorSettings {
+        unsigned int executors = 1;
+        // intra-op threads of each executor, 0 keeps libtorch's default
+        int intra_op_threads = 0;
+        // pin each executor and its intra-op threads to a core range of their own, apart from other pools
+        bool pin_threads = false;
+    };
+
+    /*
+        Runs batches of one evaluator on a set of executor threads. Each executor holds its own clone
+        of the evaluator sharing its weights, so batches from any number of searches run concurrently
+        and each goes to whichever executor is free. Replaces the process wide lock that serialized
+        every evaluation.
+    */
+    class ExecutorPool {
+    public:
+        ExecutorPool(const Evaluator& evaluator, const ExecutorSettings& settings);
+        ExecutorPool(const ExecutorPool&) = delete;
+        ExecutorPool& operator=(const ExecutorPool&) = delete;
+        ~ExecutorPool();
+
+        void submit(BatchBuffer& batch, std::function<void()> done);
+        void evaluate(BatchBuffer& batch);
+
+        inline torch::Device getDevice() const {
+            return device;
+        }
+
+        // @return Element type dense batch inputs of the evaluator must have
+        inline torch::ScalarType inputType() const {
+            return input_type;
+        }
+
+        // @return Number of batches the pool evaluates at once
+        inline unsigned int size() const {
+            return static_cast<unsigned int>(evaluators.size());
+        }
+
+    private:
+        struct Job {
+            BatchBuffer* batch;
+            std::function<void()> done;
+        };
+
+        void run(const unsigned int index);
+
+        // @return Cores each pinned executor gets, one per intra-op thread
+        inline unsigned int coreWidth() const {
+            return static_cast<unsigned int>(std::max(settings.intra_op_threads, 1));
+        }
+
+        const torch::Device device;
+        const torch::ScalarType input_type;
+        const ExecutorSettings settings;
+        // first core of the range claimed for the pool's pinned executors
+        unsigned int first_core = 0;
+        std::vector<std::unique_ptr<Evaluator>> evaluators;
+        std::vector<std::thread> threads;
+        std::queue<Job> jobs;
+        std::mutex lock;
+        std::condition_variable cv;
+        bool stopping = false;
+    };
+
+    extern ExecutorPool& executorsFor(const Evaluator& evaluator, const ExecutorSettings& settings);
+    extern void releaseExecutors(const Evaluator& evaluator);
+}
@@ -2,11 +2,75 @@
 
 #include <iostream>
 #include <vector>
-#include <mutex>
+#include <algorithm>
+#include <limits>
 #include <torch/script.h>
 #include <torch/torch.h>
+#include "include/native/network.hpp"
 
 namespace model {
-    extern std::mutex device_lock;
-    extern std::queue<std::pair<torch::Tensor, torch::Tensor>> evaluate(std::queue<torch::Tensor> inputs_tensor, torch::jit::script::Module module, const torch::Device device);
+    // most legal moves a position can have, the width of a slot's legal move list
+    constexpr unsigned int MAX_LEGAL_MOVES = 256;
+
+    /*
+        Input and output storage of one batch, allocated once and reused for every batch. Positions
+        are written straight into their slot of the input tensor and results are read back from flat
+        float tensors, so no tensor is created, stacked or split per position. Dense inputs are in the
+        network's precision. Packed batches hold one int64 bitboard per plane, which the network
+        unpacks itself, instead of 64 values.
+        Each slot also lists the policy indices of its legal moves. The logits of those moves are
+        gathered and softmaxed as part of the call, so only the priors come back to the host.
+    */
+    struct BatchBuffer {
+        BatchBuffer() = default;
+        BatchBuffer(unsigned int capacity, unsigned int planes, unsigned int policy_size, const torch::Device device, const bool packed = false,
+            const torch::ScalarType input_type = torch::kHalf);
+
+        // @return First of the planes * 64 input values of a slot as T, dense batches only, T has the size of input_type
+        template<typename T>
+        inline T* slot(const unsigned int index) {
+            return static_cast<T*>(input.data_ptr()) + static_cast<size_t>(index) * planes * 64;
+        }
+
+        // @return First of the planes bitboards of a slot, packed batches only
+        inline int64_t* packedSlot(const unsigned int index) {
+            return input.data_ptr<int64_t>() + static_cast<size_t>(index) * planes;
+        }
+
+        /*
+            Writes the legal move list of a slot, the rest of the list is masked out
+            @param indices: policy index of each legal move in edge order, -1 for a move with no index
+        */
+        inline void setLegal(const unsigned int index, const int* indices, const unsigned int count) {
+            int64_t* slot = legal_indices.data_ptr<int64_t>() + static_cast<size_t>(index) * MAX_LEGAL_MOVES;
+            std::copy(indices, indices + count, slot);
+            std::fill(slot + count, slot + MAX_LEGAL_MOVES, int64_t(-1));
+        }
+
+        // @return Priors of a slot's legal moves in the order they were listed, valid after evaluate
+        inline const float* priors(const unsigned int index) const {
+            return priors_output.data_ptr<float>() + static_cast<size_t>(index) * MAX_LEGAL_MOVES;
+        }
+
+        // @return Value of a slot, valid after evaluate
+        inline float value(const unsigned int index) const {
+            return value_output.data_ptr<float>()[index];
+        }
+
+        unsigned int capacity = 0;
+        unsigned int planes = 0;
+        unsigned int policy_size = 0;
+        bool packed = false;
+        // element type of dense inputs, the dtype of the network's weights
+        torch::ScalarType input_type = torch::kHalf;
+        // slots filled so far, only the first size slots are evaluated
+        unsigned int size = 0;
+        torch::Tensor input;
+        torch::Tensor legal_indices;
+        torch::Tensor priors_output;
+        torch::Tensor value_output;
+    };
+
+    extern void evaluate(BatchBuffer& batch, torch::jit::script::Module& module, const torch::Device device);
+    extern void evaluate(BatchBuffer& batch, const native::Network& network, native::Workspace& workspace);
 }
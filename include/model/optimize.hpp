@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include "include/model/model.hpp"
+#include "include/model/precision.hpp"
+
+namespace model {
+
+    // what a frozen module was made for, it is only valid for the same model file, precision and device
+    struct InferenceShape {
+        torch::Device device = torch::kCPU;
+        Precision precision = Precision::FP32;
+        unsigned int input_planes = 0;
+        unsigned int policy_size = 0;
+        bool packed = false;
+    };
+
+    extern torch::jit::script::Module optimizeForInference(torch::jit::script::Module& module, const std::string& model_path,
+        const InferenceShape& shape);
+}
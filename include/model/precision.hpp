@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+#include "include/model/model.hpp"
+
+namespace model {
+
+    // formats the network can run in, INT8 is a separately quantized cpu model taking fp32 input
+    enum class Precision {
+        FP32,
+        BF16,
+        FP16,
+        INT8
+    };
+
+    // @return Tensor element type of a precision
+    inline torch::ScalarType scalarType(const Precision precision) {
+        switch (precision) {
+            case Precision::BF16: return torch::kBFloat16;
+            case Precision::FP16: return torch::kHalf;
+            default: return torch::kFloat32;
+        }
+    }
+
+    // @return Name of a precision as written in params.txt
+    inline const char* precisionName(const Precision precision) {
+        switch (precision) {
+            case Precision::BF16: return "bf16";
+            case Precision::FP16: return "fp16";
+            case Precision::INT8: return "int8";
+            default: return "fp32";
+        }
+    }
+
+    // @return Precision called name in params.txt, fp32 for names that are not one
+    inline Precision precisionFromName(const std::string& name) {
+        if (name == "bf16") return Precision::BF16;
+        if (name == "fp16") return Precision::FP16;
+        if (name == "int8") return Precision::INT8;
+        return Precision::FP32;
+    }
+
+    extern Precision selectPrecision(const torch::jit::script::Module& module, const torch::Device device, const std::string& mode,
+        const unsigned int input_planes, const unsigned int policy_size, const bool packed);
+}
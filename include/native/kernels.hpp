@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <algorithm>
+// msvc defines no __FMA__, its /arch:AVX2 includes fma
+#if defined(__AVX512F__) || (defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER)))
+#include <immintrin.h>
+#endif
+
+// Float kernels of the native network. Matrices are row major, ld is the distance between rows.
+namespace native::kernels {
+
+#if defined(__AVX512F__)
+    using Vec = __m512;
+    constexpr int VEC_WIDTH = 16;
+    constexpr const char* INSTRUCTION_SET = "avx512";
+    inline Vec load(const float* p) { return _mm512_loadu_ps(p); }
+    inline void store(float* p, const Vec v) { _mm512_storeu_ps(p, v); }
+    inline Vec broadcast(const float x) { return _mm512_set1_ps(x); }
+    inline Vec fma(const Vec a, const Vec b, const Vec c) { return _mm512_fmadd_ps(a, b, c); }
+#elif defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+    using Vec = __m256;
+    constexpr int VEC_WIDTH = 8;
+    constexpr const char* INSTRUCTION_SET = "avx2";
+    inline Vec load(const float* p) { return _mm256_loadu_ps(p); }
+    inline void store(float* p, const Vec v) { _mm256_storeu_ps(p, v); }
+    inline Vec broadcast(const float x) { return _mm256_set1_ps(x); }
+    inline Vec fma(const Vec a, const Vec b, const Vec c) { return _mm256_fmadd_ps(a, b, c); }
+#else
+    // one lane, the loops below still vectorize where the compiler can, NARCHESSER_ARCH in CMakeLists.txt picks the paths above
+    using Vec = float;
+    constexpr int VEC_WIDTH = 1;
+    constexpr const char* INSTRUCTION_SET = "scalar";
+    inline Vec load(const float* p) { return *p; }
+    inline void store(float* p, const Vec v) { *p = v; }
+    inline Vec broadcast(const float x) { return x; }
+    inline Vec fma(const Vec a, const Vec b, const Vec c) { return a * b + c; }
+#endif
+
+    // rows of a register tile and depth of a cache block, a block of B columns stays in L1 while rows stream past it
+    constexpr int TILE_ROWS = 4;
+    constexpr int BLOCK_DEPTH = 256;
+
+    /*
+        Accumulates a ROWS by 2 * VEC_WIDTH tile of C += A * B over k in [k0, k1), the accumulators stay
+        in registers for the whole block
+    */
+    template<int ROWS>
+    inline void tile(const float* a, const size_t lda, const float* b, const size_t ldb, float* c, const size_t ldc, const int k0, const int k1) {
+        Vec acc[ROWS][2];
+        for (int r = 0; r < ROWS; ++r) {
+            acc[r][0] = load(c + r * ldc);
+            acc[r][1] = load(c + r * ldc + VEC_WIDTH);
+        }
+        for (int k = k0; k < k1; ++k) {
+            const Vec b0 = load(b + k * ldb);
+            const Vec b1 = load(b + k * ldb + VEC_WIDTH);
+            for (int r = 0; r < ROWS; ++r) {
+                const Vec x = broadcast(a[r * lda + k]);
+                acc[r][0] = fma(x, b0, acc[r][0]);
+                acc[r][1] = fma(x, b1, acc[r][1]);
+            }
+        }
+        for (int r = 0; r < ROWS; ++r) {
+            store(c + r * ldc, acc[r][0]);
+            store(c + r * ldc + VEC_WIDTH, acc[r][1]);
+        }
+    }
+
+    /*
+        C = A * B + bias, A is M x K, B is K x N, C is M x N
+        @param bias: N values added to every row, nullptr for none
+    */
+    inline void gemm(const float* a, const size_t lda, const float* b, const size_t ldb, float* c, const size_t ldc,
+                     const int m, const int n, const int k, const float* bias) {
+        for (int row = 0; row < m; ++row) {
+            if (bias) std::copy(bias, bias + n, c + row * ldc);
+            else std::fill(c + row * ldc, c + row * ldc + n, 0.0f);
+        }
+        constexpr int TILE_COLUMNS = 2 * VEC_WIDTH;
+        const int wide = n - n % TILE_COLUMNS;
+        for (int k0 = 0; k0 < k; k0 += BLOCK_DEPTH) {
+            const int k1 = std::min(k, k0 + BLOCK_DEPTH);
+            for (int col = 0; col < wide; col += TILE_COLUMNS) {
+                int row = 0;
+                for (; row + TILE_ROWS <= m; row += TILE_ROWS) {
+                    tile<TILE_ROWS>(a + row * lda, lda, b + col, ldb, c + row * ldc + col, ldc, k0, k1);
+                }
+                for (; row < m; ++row) {
+                    tile<1>(a + row * lda, lda, b + col, ldb, c + row * ldc + col, ldc, k0, k1);
+                }
+            }
+            // columns past the last full tile
+            for (int row = 0; row < m; ++row) {
+                float* out = c + row * ldc;
+                for (int i = k0; i < k1; ++i) {
+                    const float x = a[row * lda + i];
+                    const float* in = b + i * ldb;
+                    for (int col = wide; col < n; ++col) out[col] += x * in[col];
+                }
+            }
+        }
+    }
+
+    // Normalizes each of m rows of n values in place, then scales by gamma and shifts by beta.
+    inline void layerNorm(float* x, const size_t ldx, const int m, const int n, const float* gamma, const float* beta, const float eps = 1e-5f) {
+        for (int row = 0; row < m; ++row) {
+            float* v = x + row * ldx;
+            float mean = 0.0f;
+            for (int i = 0; i < n; ++i) mean += v[i];
+            mean /= static_cast<float>(n);
+            float variance = 0.0f;
+            for (int i = 0; i < n; ++i) variance += (v[i] - mean) * (v[i] - mean);
+            const float scale = 1.0f / std::sqrt(variance / static_cast<float>(n) + eps);
+            for (int i = 0; i < n; ++i) v[i] = (v[i] - mean) * scale * gamma[i] + beta[i];
+        }
+    }
+
+    inline void relu(float* x, const size_t count) {
+        for (size_t i = 0; i < count; ++i) x[i] = std::max(x[i], 0.0f);
+    }
+
+    // Softmax of each of m rows of n values in place.
+    inline void softmax(float* x, const size_t ldx, const int m, const int n) {
+        for (int row = 0; row < m; ++row) {
+            float* v = x + row * ldx;
+            const float top = *std::max_element(v, v + n);
+            float sum = 0.0f;
+            for (int i = 0; i < n; ++i) {
+                v[i] = std::exp(v[i] - top);
+                sum += v[i];
+            }
+            const float inverse = 1.0f / sum;
+            for (int i = 0; i < n; ++i) v[i] *= inverse;
+        }
+    }
+
+    // Writes the n x m transpose of an m x n matrix.
+    inline void transpose(const float* x, const size_t ldx, float* out, const size_t ldo, const int m, const int n) {
+        for (int row = 0; row < m; ++row) {
+            for (int col = 0; col < n; ++col) out[col * ldo + row] = x[row * ldx + col];
+        }
+    }
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "include/native/kernels.hpp"
+
+/*
+    TransformerNet of model/model.py evaluated without libtorch, for the cpu. It loads the weights
+    model/export.py --native writes, with the attention maps and scales already folded into them,
+    and runs the fixed 64 square layout through the kernels in kernels.hpp.
+*/
+namespace native {
+
+    // shape of the exported network, in the order of the weight file header
+    struct Config {
+        uint32_t input_dim = 0;
+        uint32_t seq_len = 0;
+        uint32_t position_embedding_dim = 0;
+        uint32_t embedding_dim = 0;
+        uint32_t hidden_layers = 0;
+        uint32_t attention_dim = 0;
+        uint32_t attention_heads = 0;
+        uint32_t positional_encoding_dim = 0;
+        uint32_t dim_feedforward = 0;
+        uint32_t value_model_dim = 0;
+        uint32_t policy_model_dim = 0;
+        uint32_t policy_out_dim = 0;
+    };
+
+    // Linear layer with its weight stored transposed, in x out, so rows of inputs multiply it as they are
+    struct Linear {
+        int in = 0;
+        int out = 0;
+        std::vector<float> weight;
+        // empty for a layer without bias
+        std::vector<float> bias;
+
+        inline void apply(const float* x, const size_t ldx, const int rows, float* y, const size_t ldy) const {
+            kernels::gemm(x, ldx, weight.data(), out, y, ldy, rows, out, in, bias.empty() ? nullptr : bias.data());
+        }
+    };
+
+    struct LayerNorm {
+        std::vector<float> gamma;
+        std::vector<float> beta;
+
+        inline void apply(float* x, const size_t ldx, const int rows) const {
+            kernels::layerNorm(x, ldx, rows, static_cast<int>(gamma.size()), gamma.data(), beta.data());
+        }
+    };
+
+    struct PositionalEncoding {
+        Linear p_enc;
+        LayerNorm norm1;
+        Linear linear;
+        LayerNorm norm2;
+        Linear p_dec;
+    };
+
+    struct AttentionBlock {
+        Linear qkv;
+        PositionalEncoding p_enc;
+        Linear out;
+        LayerNorm norm1;
+        Linear feedforward1;
+        Linear feedforward2;
+        LayerNorm norm2;
+    };
+
+    // scratch memory of forward passes, one per thread, grown on first use and reused after
+    struct Workspace {
+        std::vector<float> input;
+        std::vector<float> logits;
+        std::vector<float> values;
+        // activations of a chunk of positions, rows are squares
+        std::vector<float> x;
+        std::vector<float> residual;
+        std::vector<float> wide;
+        std::vector<float> projected;
+        std::vector<float> attention;
+        // positional encoding stages, biases holds one row of attention biases per square and head
+        std::vector<float> encoding;
+        std::vector<float> encoded;
+        std::vector<float> biases;
+        // one head of one position
+        std::vector<float> keys;
+        std::vector<float> scores;
+        std::vector<float> head;
+    };
+
+    class Network {
+    public:
+        explicit Network(const std::string& path);
+
+        void forward(const float* input, const int batch, float* policy, float* value, Workspace& workspace) const;
+
+        inline const Config& config() const {
+            return shape;
+        }
+
+        // @return Input planes of one position
+        inline unsigned int planes() const {
+            return shape.input_dim * shape.seq_len / 64;
+        }
+
+        // @return Policy logits of one position
+        inline unsigned int policySize() const {
+            return shape.seq_len * shape.policy_out_dim;
+        }
+
+    private:
+        void forwardChunk(const float* input, const int positions, float* policy, float* value, Workspace& workspace) const;
+        void encode(const PositionalEncoding& encoding, const float* x, const int rows, Workspace& workspace) const;
+        void attend(const float* queries, const size_t ldq, const size_t query_position_stride, const size_t query_head_stride,
+                    const float* keys, const size_t ldkv, const size_t kv_head_stride, const size_t value_offset,
+                    const int positions, const int head_dim, float* out, const size_t ldo, Workspace& workspace) const;
+
+        Config shape;
+        // input embedding, linear1 has no bias, the attention map's share of it is map_bias
+        Linear embedding;
+        LayerNorm embedding_norm1;
+        Linear embedding_linear1;
+        std::vector<float> map_bias;
+        LayerNorm embedding_norm2;
+        std::vector<AttentionBlock> blocks;
+        Linear value_linear1;
+        Linear value_linear2;
+        Linear value_linear3;
+        // per head queries of the policy attention, already scaled
+        std::vector<float> policy_query;
+        Linear policy_kv;
+        PositionalEncoding policy_p_enc;
+        Linear policy_out;
+        LayerNorm policy_norm;
+        Linear policy_linear;
+    };
+}
@@ -7,7 +7,11 @@
 #include <memory> 
 
 namespace planes {
-    extern std::unique_ptr<Bitboard[]> toPlane(const Board& board, Color color);
-    extern std::unique_ptr<Bitboard[]> extraPlanes(const Board& board);
-    extern std::unique_ptr<Bitboard[]> emptyPlane();
+    constexpr int POSITION_PLANES = 14;
+    constexpr int EXTRA_PLANES = 6;
+
+    // planes are written into caller provided arrays of POSITION_PLANES or EXTRA_PLANES bitboards
+    extern void toPlane(const Board& board, Color color, int repetitions, Bitboard* plane);
+    extern void extraPlanes(const Board& board, Bitboard* plane);
+    extern void emptyPlane(Bitboard* plane);
 }
@@ -24,4 +24,16 @@ inline float cpuct(int visits) {return cpuct_init + cpuct_factor * fast_log((vis
 extern int checks_before_move;
 extern int growth_before_check;
 extern int thread_count;
+extern int search_threads;
 extern int transposition_table_size;
+extern std::string batching_profile;
+extern int packed_input;
+extern int inference_executors;
+extern int intra_op_threads;
+extern int pin_executor_threads;
+extern std::string inference_precision;
+extern std::string inference_backend;
+extern int mock_batch_latency_us;
+extern int mock_position_latency_us;
+extern int nn_batch_size;
+extern std::string tuning_profile;
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <utility>
+#include <vector>
+#include "node.hpp"
+#include "mpsc_queue.hpp"
+#include "threadpool.hpp"
+#include "include/model/model.hpp"
+#include "include/model/executor.hpp"
+#include "include/model/encoder.hpp"
+
+// leaf waiting on the network, carries what evaluation needs since nodes hold no board
+struct EvalRequest {
+    Node* node = nullptr;
+    uint64_t hash = 0;
+    chess::Color side = chess::Color::WHITE;
+};
+
+// what an inference stage evaluated, complete once it has finished or stopped
+struct InferenceStats {
+    uint64_t positions = 0;
+    // time from handing each batch to the executors until its results were ready, in completion order
+    std::vector<std::chrono::microseconds> batch_latencies;
+};
+
+/*
+    How long a partial batch may wait for more leaves before it is evaluated anyway. The deadline
+    follows the measured model latency, a batch waits at most latency_fraction of one evaluation
+    for company, clamped to [min_deadline, max_deadline].
+*/
+struct BatchingProfile {
+    // 0 keeps the search's batch size, otherwise caps it
+    unsigned int max_batch_size = 0;
+    float latency_fraction = 1.0f;
+    std::chrono::microseconds min_deadline{100};
+    std::chrono::microseconds max_deadline{5000};
+
+    // small batches flushed quickly, for short time controls
+    static BatchingProfile lowLatency() {
+        return {8, 0.25f, std::chrono::microseconds(20), std::chrono::microseconds(250)};
+    }
+
+    // full batches, for self play and long searches
+    static BatchingProfile highThroughput() {
+        return {0, 1.0f, std::chrono::microseconds(100), std::chrono::microseconds(5000)};
+    }
+
+    // @return Profile called name in params.txt, high throughput if the name is unknown, which the config reports
+    static BatchingProfile named(const std::string& name) {
+        return name == "low_latency" ? lowLatency() : highThroughput();
+    }
+};
+
+/*
+    Runs network evaluations on a thread of its own. Search threads submit encoded leaves through a
+    lock free queue and carry on searching, this thread forms batches from the queue and hands them
+    to the model's executors, and a pool of dispatch threads writes the results back to their nodes.
+    Batch buffers rotate, one more than there are executors, so every executor can evaluate a batch
+    of this stage while the next one is being filled and earlier results are dispatched.
+    A batch is evaluated once it is full, flushed, or its oldest leaf has waited past the deadline.
+    A search keeps its stage across moves, finish drains it at the end of each search so the threads
+    and buffers are only set up once.
+*/
+class InferenceStage {
+public:
+    // priors holds one prior per edge of the request's node, in edge order
+    using Dispatch = std::function<void(const float* priors, const float value, const EvalRequest& request)>;
+    using Clock = std::chrono::steady_clock;
+
+    InferenceStage(model::ExecutorPool& executors, unsigned int batch_size, unsigned int input_planes, unsigned int policy_size,
+        bool packed_input, unsigned int dispatch_threads, Dispatch dispatch,
+        const BatchingProfile& profile = BatchingProfile::highThroughput(), std::chrono::microseconds latency = std::chrono::microseconds(0));
+    InferenceStage(const InferenceStage&) = delete;
+    InferenceStage& operator=(const InferenceStage&) = delete;
+    ~InferenceStage();
+
+    void submit(EncodedState state, const EvalRequest& request);
+    void flush();
+    void finish();
+    void stop();
+    void waitForBatch(const uint64_t seen);
+
+    // @return Number of batches whose results have all been written back to their nodes
+    inline uint64_t completedBatches() const {
+        return completed.load(std::memory_order_acquire);
+    }
+
+    // @return Smoothed time of one model call, 0 until a batch has been evaluated
+    inline std::chrono::microseconds latency() const {
+        return std::chrono::microseconds(latency_us.load(std::memory_order_relaxed));
+    }
+
+    // @return Everything the stage evaluated since the last call, only once it has finished or stopped
+    inline InferenceStats takeStats() {
+        std::lock_guard<std::mutex> guard(completed_lock);
+        return std::exchange(stats, InferenceStats{});
+    }
+
+private:
+    struct Item {
+        EncodedState state;
+        EvalRequest request;
+        Clock::time_point submitted;
+    };
+
+    struct Batch {
+        model::BatchBuffer buffer;
+        std::vector<EvalRequest> requests;
+        // results of this buffer not yet written back, the buffer is refilled only once it is 0
+        std::atomic<uint32_t> outstanding = 0;
+        // set while an executor holds the batch, guarded by completed_lock
+        bool evaluating = false;
+    };
+
+    void run();
+    bool collect(Batch& batch);
+    void add(Batch& batch, const Item& item);
+    void evaluate(Batch& batch);
+    void finished(Batch& batch, const Clock::time_point start);
+    void drain(Batch& batch);
+    void wake();
+    void sleep(const uint64_t seen, const Clock::time_point until);
+    std::chrono::microseconds deadline() const;
+
+    model::ExecutorPool& executors;
+    const unsigned int batch_size;
+    Dispatch dispatch;
+    const BatchingProfile profile;
+    std::atomic<int64_t> latency_us;
+
+    MPSCQueue<Item> queue;
+    // bumped on every submit, flush, finish and stop, the inference thread sleeps until it changes or a deadline passes
+    std::atomic<uint64_t> signal = 0;
+    std::atomic<bool> sleeping = false;
+    std::mutex wake_lock;
+    std::condition_variable wake_cv;
+    std::atomic<bool> flush_requested = false;
+    std::atomic<bool> stopping = false;
+    // finish calls made and answered, a call returns once finish_answered reaches its ticket
+    std::atomic<uint64_t> finish_requested = 0;
+    std::atomic<uint64_t> finish_answered = 0;
+    // request the inference thread found the queue empty for, only touched by that thread
+    uint64_t finishing = 0;
+
+    std::vector<std::unique_ptr<Batch>> batches;
+    std::atomic<uint64_t> completed = 0;
+    // guarded by completed_lock
+    InferenceStats stats;
+    std::mutex completed_lock;
+    std::condition_variable completed_cv;
+
+    std::unique_ptr<ThreadPool> dispatch_pool;
+    std::thread worker;
+};
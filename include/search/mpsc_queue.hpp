@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <utility>
+
+/*
+    Unbounded multi-producer single-consumer queue. Producers link a new cell with one atomic
+    exchange and never wait on each other or on the consumer. Only one thread may pop, and a pop
+    can miss a cell whose producer has exchanged the head but not linked it yet, the cell shows up
+    on a later pop.
+*/
+template<typename T>
+class MPSCQueue {
+public:
+    MPSCQueue() {
+        Cell* stub = new Cell();
+        head.store(stub, std::memory_order_relaxed);
+        tail = stub;
+    }
+
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+    ~MPSCQueue() {
+        T discarded;
+        while (pop(discarded));
+        delete tail;
+    }
+
+    void push(T value) {
+        Cell* cell = new Cell();
+        cell->value = std::move(value);
+        Cell* prev = head.exchange(cell, std::memory_order_acq_rel);
+        prev->next.store(cell, std::memory_order_release);
+    }
+
+    // @return true and moves the oldest linked value into out, consumer thread only
+    bool pop(T& out) {
+        Cell* next = tail->next.load(std::memory_order_acquire);
+        if (next == nullptr) return false;
+        out = std::move(next->value);
+        delete tail;
+        tail = next;
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<Cell*> next = nullptr;
+        T value;
+    };
+
+    std::atomic<Cell*> head;
+    Cell* tail;
+};
@@ -2,7 +2,8 @@
 
 #include <memory>
 #include <vector>
-#include <list>
+#include <new>
+#include <cstdint>
 #include <iostream>
 #include <cmath>
 #include <utility>
@@ -12,6 +13,7 @@
 #include <queue>
 #include <algorithm>
 #include <condition_variable>
+#include <thread>
 #include "constants.hpp"
 #include "include/chess.hpp"
 #include "include/planes.hpp"
@@ -19,131 +21,297 @@
 class Node;
 class Container;
 
+// move and prior of a legal move, the child node is only created on the first visit
+struct Edge {
+    chess::Move move;
+    float policy = 0.0f;
+    std::atomic<Node*> child = nullptr;
+};
+
+// Nodes hold no board, search threads replay the moves along their path on a board of their own
 struct Node {
 
-    std::vector<Node*> children = {};
-    std::vector<Node*> prev_list = {};
-    float policy = 0.0f;
-    std::atomic<int> visits = 0;
-    std::atomic<float> val_sum = 0.0f;
+    std::unique_ptr<Edge[]> edges;
+    uint16_t num_moves = 0;
+    std::atomic<bool> expanded = false;
+    Node* parent = nullptr;
+    uint16_t depth = 0;
+    // visits in the low half, visits still in flight below this node in the high half
+    std::atomic<uint64_t> counts = 0;
+    // sum of backed up values in fixed point
+    std::atomic<int64_t> value_sum = 0;
     uint8_t moves_since_cpm;
     float progress_mult = 1.0f;
     // bool check_or_cap;
     chess::Move move;
-    chess::Board state;
     
-    std::mutex lock;
     std::mutex expand_lock;
+    // set by the one thread that expands this leaf, later arrivals count a collision and back out
     std::atomic<bool> in_nnet = false;
-    std::atomic<bool> virtual_loss = false;
-    std::condition_variable nnet_cv;
 
 
+    static constexpr int IN_FLIGHT_SHIFT = 32;
+    static constexpr uint64_t IN_FLIGHT_ONE = uint64_t(1) << IN_FLIGHT_SHIFT;
+    static constexpr uint64_t VISIT_MASK = IN_FLIGHT_ONE - 1;
+    static constexpr double VALUE_SCALE = double(1 << 24);
+
     inline Node* getParent() const;
-    inline uint8_t getDepth() const;
-    Node(Container& container, chess::Board state, uint8_t moves_since_cpm, chess::Move move = chess::Move::NULL_MOVE, std::vector<Node*> prev_list = {}, float policy = 0.0f);
-    inline float puct_value(const float v_loss_c = 1.0f);
+    inline uint16_t getDepth() const;
+    Node(uint8_t moves_since_cpm, chess::Move move = chess::Move::NULL_MOVE, Node* parent = nullptr);
+    inline float puct_value(const Edge& edge, const float v_loss_c = 1.0f) const;
     inline bool is_leaf_node() const;
-    std::pair<bool, float> get_terminal_val() const;
-    void expand(chess::Move newMove, float policy, Container& container);
-    inline void addToVal(float val);
+    inline uint16_t edgeCount() const;
+    std::pair<bool, float> get_terminal_val(const chess::Board& board) const;
+    void setMoves(const chess::Movelist& movelist);
+    chess::Movelist getMoves() const;
+    template<typename PriorFn>
+    void expand(PriorFn prior);
+    template<typename PriorFn>
+    void expand(const chess::Movelist& movelist, PriorFn prior);
+    inline void expandPriors(const float* priors);
+    Node* getChild(const uint16_t index, Container& container, const chess::Board& board);
+    inline int getVisits() const;
+    inline int getInFlight() const;
+    inline float getValueSum() const;
+    inline void addVisit();
+    inline void addInFlight();
+    inline void removeInFlight();
+    inline void completeVisit(float val);
     inline float cpmToMult(const uint8_t moves_since_cpm) const;
     void backpropagate(float val, Container& container);
+    void cancelVisit();
     inline float getQ(const float v_loss = 0.0f) const;
 };
 
 
+/*
+    Arena owning every node of a search. Each thread bump allocates from its own slab so creating a
+    node takes no shared lock, the mutex is only taken to hand out a slab. Slabs are aligned to their
+    size so a node finds its slab from its address. A slab is owned by the thread allocating from it
+    until it is full or closeSlabs hands it back, an unowned slab whose nodes have all been released
+    goes back on the free list to be reused. Subtrees discarded when the root moves are
+    released by a background reclaimer thread so the caller does not wait on them.
+*/
 struct Container {
 
     friend class Search;
 
     public:
-        Container() {}
+        struct Slab {
+            static constexpr size_t BYTES = size_t(1) << 18;
+            static constexpr uint32_t CAPACITY = static_cast<uint32_t>((BYTES - 64) / (sizeof(Node) + 1) - 1);
+
+            std::atomic<uint32_t> used = 0;
+            std::atomic<uint32_t> live = 0;
+            // guarded by the container's lock
+            bool owned = false;
+            bool free = false;
+            bool alive[CAPACITY] = {};
+            alignas(Node) unsigned char storage[CAPACITY * sizeof(Node)];
+
+            inline Node* at(const uint32_t index) {
+                return reinterpret_cast<Node*>(storage) + index;
+            }
+        };
+
+        Container() : owner_id(next_id.fetch_add(1, std::memory_order_relaxed)) {}
+        Container(const Container&) = delete;
+        Container& operator=(const Container&) = delete;
 
         ~Container() {
-            for (auto& n :list) {
-                delete n;
+            {
+                std::lock_guard<std::mutex> guard(reclaim_lock);
+                stopping = true;
+            }
+            reclaim_cv.notify_one();
+            if (reclaimer.joinable()) reclaimer.join();
+            for (auto slab : slabs) {
+                const uint32_t used = slab->used.load(std::memory_order_relaxed);
+                for (uint32_t i = 0; i < used; ++i) {
+                    if (slab->alive[i]) slab->at(i)->~Node();
+                }
+                slab->~Slab();
+                ::operator delete(slab, std::align_val_t(Slab::BYTES));
             }
             // std::cout << "Container Freed\n";
         }
 
-        void push(Node* node) {
-            std::lock_guard<std::mutex> guard(lock);
-            list.push_back(node);
+        template<typename... Args>
+        Node* create(Args&&... args) {
+            const auto [slab, index] = allocate();
+            Node* node = new (slab->at(index)) Node(std::forward<Args>(args)...);
+            slab->alive[index] = true;
+            slab->live.fetch_add(1, std::memory_order_relaxed);
+            slab->used.store(index + 1, std::memory_order_release);
+            live_nodes.fetch_add(1, std::memory_order_relaxed);
+            if (index + 1 == Slab::CAPACITY) disown(slab);
+            return node;
         }
 
-        std::list<Node*>::iterator removeNode(const std::list<Node*>::iterator it) {
-            delete *it;
-            *it = nullptr;
-            std::list<Node*>::iterator nextIt = list.erase(it);
-            return nextIt;
-        }
+        void release(Node* node);
+        void closeSlabs();
+        void reclaim(Node* root, const Node* keep = nullptr);
 
         uint32_t size() const {
-            return list.size();
+            return live_nodes.load(std::memory_order_relaxed);
         }
 
         bool empty() const {
-            return !list.size();
+            return size() == 0;
         }
 
-        Node* front() const {
-            return list.front();
-        }
+    private:
+        std::pair<Slab*, uint32_t> allocate();
+        Slab* newSlab();
+        void disown(Slab* slab);
+        void recycle(Slab* slab);
+        void reclaimLoop();
 
-        Node* back() const {
-            return list.back();
+        static inline Slab* slabOf(const Node* node) {
+            return reinterpret_cast<Slab*>(reinterpret_cast<uintptr_t>(node) & ~(Slab::BYTES - 1));
         }
 
-        std::list<Node*> list;
-
-    private:
+        static inline std::atomic<uint64_t> next_id = 0;
+        // threads only allocate from a slab they took while this id was current
+        std::atomic<uint64_t> owner_id;
+        std::atomic<uint32_t> live_nodes = 0;
+        std::vector<Slab*> slabs;
+        std::vector<Slab*> free_slabs;
         std::mutex lock;
+
+        std::thread reclaimer;
+        std::mutex reclaim_lock;
+        std::condition_variable reclaim_cv;
+        std::vector<std::pair<Node*, const Node*>> pending;
+        bool stopping = false;
 };
 
 inline Node* Node::getParent() const {
-    if (!prev_list.empty()) return prev_list.back();
-    return nullptr;
+    return parent;
 }
 
-inline uint8_t Node::getDepth() const {
-    return prev_list.size();
+// @return Plies from the node the tree was started from, fixed at creation so moving the root touches no node
+inline uint16_t Node::getDepth() const {
+    return depth;
 }
 
-inline float Node::puct_value(const float v_loss_c /* = 1.0f */) {
-    const int n = visits.load(std::memory_order_relaxed);
-    const bool vloss = virtual_loss.load(std::memory_order_relaxed);
+/*
+    @return PUCT value of one of this node's edges
+    @param edge: edge of this node to score
+    @param v_loss_c: Virtual loss applied while a visit is in flight
+*/
+inline float Node::puct_value(const Edge& edge, const float v_loss_c /* = 1.0f */) const {
+    const Node* child = edge.child.load(std::memory_order_acquire);
+
+    // Edges without a child have never been selected
+    if (child == nullptr) {
+        return std::numeric_limits<float>::infinity();
+    }
+
+    const uint64_t counts = child->counts.load(std::memory_order_relaxed);
+    const int n = static_cast<int>(counts & VISIT_MASK);
+    const int in_flight = static_cast<int>(counts >> IN_FLIGHT_SHIFT);
 
     // Unvisited nodes: encourage first visit unless someone is already “in flight”
     if (n == 0) {
-        return vloss ? -std::numeric_limits<float>::infinity()
-                     :  std::numeric_limits<float>::infinity();
+        return in_flight > 0 ? -std::numeric_limits<float>::infinity()
+                             :  std::numeric_limits<float>::infinity();
     }
 
-    const Node* parent = getParent();
-    if (parent == nullptr) {
-        std::cout << "Parent is nullptr\n";
-        return std::numeric_limits<float>::infinity();
-    }
-    const int parent_n = parent->visits.load(std::memory_order_relaxed);
+    const int parent_n = getVisits();
 
-    // Treat virtual loss as extra temporary visits on this edge only
-    const float v_loss = vloss ? v_loss_c : 0.0f;
+    // Treat virtual loss as extra temporary visits on this edge only, one per visit in flight
+    const float v_loss = static_cast<float>(in_flight) * v_loss_c;
     const float denom  = 1.0f + static_cast<float>(n) + v_loss;
 
     // U term uses parent count (matches sqrt(N_parent) form)
-    const float U = cpuct(parent_n) * policy *
+    const float U = cpuct(parent_n) * edge.policy *
                     std::sqrt(static_cast<float>(parent_n)) / denom;
 
-    return getQ(v_loss) * progress_mult + U;
+    return child->getQ(v_loss) * child->progress_mult + U;
 }
 
 inline bool Node::is_leaf_node() const {
-    return children.empty();
+    return edgeCount() == 0;
+}
+
+// @return Number of edges, 0 until the node's priors have been published
+inline uint16_t Node::edgeCount() const {
+    return expanded.load(std::memory_order_acquire) ? num_moves : 0;
 }
 
-inline void Node::addToVal(const float val) {
-    val_sum.fetch_add(val, std::memory_order_relaxed);
+/*
+    Writes the priors of the edges created by setMoves, edges are published only once every prior is written
+    @param prior: callable returning the prior of a move
+*/
+template<typename PriorFn>
+void Node::expand(PriorFn prior) {
+    std::lock_guard<std::mutex> guard(expand_lock);
+    if (expanded.load(std::memory_order_relaxed)) return;
+    for (uint16_t i = 0; i < num_moves; ++i) {
+        edges[i].policy = prior(edges[i].move);
+    }
+    expanded.store(true, std::memory_order_release);
+}
+
+/*
+    Creates and publishes the edge array in one step
+    @param movelist: legal moves of the position
+    @param prior: callable returning the prior of a move
+*/
+template<typename PriorFn>
+void Node::expand(const chess::Movelist& movelist, PriorFn prior) {
+    setMoves(movelist);
+    expand(prior);
+}
+
+/*
+    Writes the priors of the edges created by setMoves from an array in edge order and publishes them
+    @param priors: one prior per edge
+*/
+inline void Node::expandPriors(const float* priors) {
+    std::lock_guard<std::mutex> guard(expand_lock);
+    if (expanded.load(std::memory_order_relaxed)) return;
+    for (uint16_t i = 0; i < num_moves; ++i) {
+        edges[i].policy = priors[i];
+    }
+    expanded.store(true, std::memory_order_release);
+}
+
+inline int Node::getVisits() const {
+    return static_cast<int>(counts.load(std::memory_order_relaxed) & VISIT_MASK);
+}
+
+inline int Node::getInFlight() const {
+    return static_cast<int>(counts.load(std::memory_order_relaxed) >> IN_FLIGHT_SHIFT);
+}
+
+inline float Node::getValueSum() const {
+    return static_cast<float>(static_cast<double>(value_sum.load(std::memory_order_relaxed)) / VALUE_SCALE);
+}
+
+// Counts a visit that ends at this node without passing through it, used for the root
+inline void Node::addVisit() {
+    counts.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Marks a visit as in flight below this node, it acts as virtual loss until the visit completes
+inline void Node::addInFlight() {
+    counts.fetch_add(IN_FLIGHT_ONE, std::memory_order_relaxed);
+}
+
+// Drops a visit in flight without counting it
+inline void Node::removeInFlight() {
+    counts.fetch_sub(IN_FLIGHT_ONE, std::memory_order_relaxed);
+}
+
+/*
+    Turns one in flight visit into a completed one in a single atomic add
+    @param val: value backed up by the visit
+*/
+inline void Node::completeVisit(const float val) {
+    value_sum.fetch_add(std::llround(static_cast<double>(val) * VALUE_SCALE), std::memory_order_relaxed);
+    counts.fetch_add(1 - IN_FLIGHT_ONE, std::memory_order_relaxed);
 }
 
 /*
@@ -160,8 +328,8 @@ inline float Node::cpmToMult(const uint8_t moves_since_cpm) const {
     @param v_loss: Virtual loss
 */
 inline float Node::getQ(const float v_loss) const {
-    const int n = visits.load(std::memory_order_relaxed);
+    const int n = getVisits();
     if (n <= 0) return 0.0f;
-    const float w = val_sum.load(std::memory_order_relaxed);
+    const float w = getValueSum();
     return w/(n + v_loss);
 }
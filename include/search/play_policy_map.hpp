@@ -98,7 +98,8 @@ constexpr PolicyMap initializePolicyMap() {
 
 namespace policy_map {
     extern std::unique_ptr<float[]> get_move_to_policy(std::unordered_map<chess::Move, float>& move_map, chess::Color color);
-    extern std::unordered_map<chess::Move, float> policy_to_moves(const std::vector<float> policy, const chess::Board& state);
+    extern std::unordered_map<chess::Move, float> policy_to_moves(const float* policy, const chess::Movelist& moves, chess::Color color);
+    extern int move_to_index(chess::Move move, chess::Color color);
 }
 
 constexpr PolicyMap policyMap = initializePolicyMap();
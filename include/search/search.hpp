@@ -7,9 +7,11 @@
 #include "play_policy_map.hpp"
 #include "transposition_table.hpp"
 #include "threadpool.hpp"
+#include "inference.hpp"
 #include "include/utils/functions.hpp"
 #include "include/model/encoder.hpp"
 #include "include/model/model.hpp"
+#include "include/model/executor.hpp"
 
 class Search {
 
@@ -18,47 +20,51 @@ class Search {
     unsigned int num_simulations;
     uint8_t max_depth = 0;
     std::mutex depth_lock;
-    uint32_t total_nodes = 1;
+    // visits the root already had from earlier moves when the current search started
+    int reused_visits = 0;
+    // playouts backed out because they reached a leaf already being evaluated
+    std::atomic<uint64_t> collisions = 0;
     Node* rootNode = nullptr;
-    torch::jit::script::Module& nnet;
-    torch::Device device;
+    chess::Board rootState;
+    uint64_t root_id;
+    // executors of the evaluator, shared with every other search using it
+    model::ExecutorPool& executors;
     Container& container;
     std::vector<chess::Board>& traversed;
-    TranspositionTable<uint64_t, std::pair<std::unordered_map<chess::Move, float>, float>>& transposition_table;
+    EvalTable& transposition_table;
     unsigned int nn_batch_size;
     const int policySize = PLANES * BOARD_SIZE * BOARD_SIZE;
     bool depthVerbose;
     const uint8_t position_history;
+    // input planes of the positions before the root, shared by every leaf of a search
+    RootHistory root_history;
+    // network evaluations, created by the first search and kept across moves, drained when each search ends
+    std::unique_ptr<InferenceStage> inference;
+    // single slot batch the root is evaluated with when it is not cached, kept across moves like the stage
+    model::BatchBuffer root_batch;
+    // model latency measured by earlier searches, seeds the batch deadline of the next one
+    std::chrono::microseconds model_latency{0};
+    // evaluations of the last search, the root's own evaluation is not counted
+    InferenceStats inference_stats;
 
-    bool evaluating = false;
-    std::condition_variable evaluating_cv;
-
-    Search(Node* rootNode, Container& container, std::vector<chess::Board>& traversed, TranspositionTable<uint64_t, std::pair<std::unordered_map<chess::Move, float>, float>>& transposition_table, 
-        torch::jit::script::Module& nnet, torch::Device device, unsigned int num_simulations, 
+    Search(Node* rootNode, const chess::Board& rootState, Container& container, std::vector<chess::Board>& traversed, EvalTable& transposition_table, 
+        const model::Evaluator& evaluator, unsigned int num_simulations, 
         unsigned int num_threads, unsigned int nn_batch_size, bool depthVerbose = false, const uint8_t position_history = 1);
     chess::Movelist get_moves(const chess::Board& state) const;
-    void evaluate_nodes();
-    void expand_leaf(Node* node, std::unique_lock<std::mutex> lock);
+    void expand_leaf(Node* node, chess::Board& board);
     void expandRoot(Node* root, const bool noise);
-    void expand(Node* node);
-    void move_root(const Node* newRoot);
+    bool expand(Node* node, chess::Board& board);
+    Node* selectChild(Node* node, const chess::Board& board);
+    void move_root(Node* newRoot);
     std::pair<chess::Move, int> selectMove(const bool verbose, double temperature, float resign_threshold = 1.0);
     void makeMove(const chess::Move m);
-    void nn_eval_request(const unsigned int batch_size);
-    std::pair<std::pair<torch::Tensor, torch::Tensor>, Node*> get_evaluation();
     float getRootQ() const;
     std::string getTopLine();
-    inline void checkMaxDepth(const uint8_t depth);
+    inline void checkMaxDepth(const Node* node);
     inline void startSearch(const bool dirichelet_noise, bool use_time = false, std::chrono::duration<int> const& max_time = std::chrono::seconds(0));
-    inline void pushToCache(torch::Tensor state_tensor, Node* node);
 
     private:
-    std::mutex cache_lock;
-    std::mutex request_guard;
-    std::mutex eval_guard;
-    std::queue<torch::Tensor> nn_cache;
-    std::queue<Node*> nn_address_cache;
-    std::queue<std::pair<torch::Tensor, torch::Tensor>> nn_evaluations;
+    static inline std::atomic<uint64_t> next_root_id = 0;
 
     struct ThreadManager {
 
@@ -66,9 +72,8 @@ class Search {
         ThreadManager(Search& search) : search(search) {};
         void startSearch(const bool dirichelet_noise, bool use_time, std::chrono::duration<int> const& max_time);
         void workerSearch();
-        void threadEvaluation();
-        void evaluate();
-        void evaluateRoot(const bool noise);
+        void evaluate(const float* policy, const float value_output, const EvalRequest& request);
+        void evaluateRoot(const float* policy, const float value_output, const EvalRequest& request, const bool noise);
         bool already_started = false;
 
         std::atomic<int> waiting_threads = 0;
@@ -78,34 +83,34 @@ class Search {
     ThreadManager threadManager;
 };
 
-inline void Search::pushToCache(torch::Tensor state_tensor, Node* node) {
-    std::unique_lock<std::mutex> guard(cache_lock);
-    while (evaluating) evaluating_cv.wait(guard);
-    nn_cache.push(state_tensor);
-    nn_address_cache.push(node);
-    guard.unlock();
-}
-
-inline void Search::checkMaxDepth(const uint8_t depth) {
+// @param node: node a playout ended on, its depth is shown relative to the current root
+inline void Search::checkMaxDepth(const Node* node) {
+    const int depth = node->getDepth() - rootNode->getDepth();
     std::lock_guard<std::mutex> guard(depth_lock);
     if (depth > max_depth) {
         max_depth = depth;
-        std::cout << "\rDEPTH: " << static_cast<unsigned int>(max_depth) << ", NODES: " << container.size() << ", TTF: " << std::ceil(10000*static_cast<float>(transposition_table.size())/static_cast<float>(transposition_table.max_elements))/100 << "%" << std::flush;
+        std::cout << "\rDEPTH: " << static_cast<unsigned int>(max_depth) << ", NODES: " << container.size() << ", TTF: " << std::ceil(10000*static_cast<float>(transposition_table.size())/static_cast<float>(transposition_table.max_elements))/100 << "%, COLLISIONS: " << collisions.load(std::memory_order_relaxed) << std::flush;
     }
 }
 
 inline void Search::startSearch(const bool dirichelet_noise, bool use_time, std::chrono::duration<int> const& max_time) {
     max_depth = 0;
+    reused_visits = rootNode->getVisits();
+    collisions.store(0, std::memory_order_relaxed);
+    transposition_table.new_generation();
+    root_history.set(traversed, position_history);
     threadManager.startSearch(dirichelet_noise, use_time, max_time);
-    nn_eval_request(1);
 }
 
 inline float Search::getRootQ() const {
     auto total_visits = 0;
     float total_value = 0.0f;
-    for (const auto& child : rootNode->children) {
-        total_visits += child->visits.load();
-        total_value += child->val_sum.load();
+    const uint16_t num_edges = rootNode->edgeCount();
+    for (uint16_t i = 0; i < num_edges; ++i) {
+        const Node* child = rootNode->edges[i].child.load(std::memory_order_acquire);
+        if (child == nullptr) continue;
+        total_visits += child->getVisits();
+        total_value += child->getValueSum();
     }
     return total_value/static_cast<float>(total_visits);
 }
@@ -48,13 +48,16 @@ public:
             std::string top_move = "";
             while (std::chrono::high_resolution_clock::now() < end) {
                 std::this_thread::sleep_for(std::chrono::seconds(1));
-                if (rootNode->visits.load() > growth_before_check * i) {
+                if (rootNode->getVisits() > growth_before_check * i) {
                     ++i;
                     int max_visits = 0;
                     int second_to_max_visits = 0;
                     std::string best_move = "";
-                    for (const auto& child : rootNode->children) {
-                        auto visits = child->visits.load();
+                    const uint16_t num_edges = rootNode->edgeCount();
+                    for (uint16_t e = 0; e < num_edges; ++e) {
+                        const Node* child = rootNode->edges[e].child.load(std::memory_order_acquire);
+                        if (child == nullptr) continue;
+                        auto visits = child->getVisits();
                         if (visits > max_visits) {
                             second_to_max_visits = max_visits;
                             max_visits = visits;
@@ -1,64 +1,213 @@
 #pragma once
 
-#include <map>
-#include <list>
-#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
 #include "include/chess.hpp"
+#include "play_policy_map.hpp"
+#include "node.hpp"
 
-template<typename K, typename V>
+// minimal test-and-test-and-set lock, small enough to live inside a bucket
+class SpinLock {
+public:
+    void lock() {
+        while (flag.test_and_set(std::memory_order_acquire)) {
+            while (flag.test(std::memory_order_relaxed));
+        }
+    }
+
+    void unlock() {
+        flag.clear(std::memory_order_release);
+    }
+
+private:
+    std::atomic_flag flag = ATOMIC_FLAG_INIT;
+};
+
+/*
+    Fixed capacity, open addressed hash table. Keys map to a single bucket: one cache line header
+    holding the lock, the full 64 bit hashes of its entries and their generations, followed by SLOTS
+    values. Comparing the full hash means two positions only alias if their hashes are identical. A probe reads the
+    header and at most one value, threads only contend when they hit the same bucket. When a bucket
+    is full the entry from the oldest search generation is replaced.
+*/
+template<typename K, typename V, int SLOTS = 4>
 class TranspositionTable {
 public:
     TranspositionTable() {}
-    void addHash(const K key, const V value) {
-        std::unique_lock<std::mutex> lock(guard);
-        // Check if the key already exists
-        auto it = std::find(keys.begin(), keys.end(), key);
-        if (it != keys.end()) {
-            // Move the key to the end to mark it as recently used
-            keys.erase(it);
-            keys.push_back(key);
-        } else {
-            // If adding a new key would exceed the max size, remove the oldest key
-            if (table.size() == max_elements) {
-                K old_key = keys.front();
-                table.erase(old_key);
-                keys.pop_front();
+
+    void addHash(const K key, const V& value) {
+        const uint64_t hash = std::hash<K>{}(key);
+        Bucket& bucket = buckets[hash & mask];
+        std::lock_guard<SpinLock> guard(bucket.lock);
+        const uint8_t gen = generation.load(std::memory_order_relaxed);
+        int replace = 0;
+        int oldest = -1;
+        for (int i = 0; i < SLOTS; ++i) {
+            if (bucket.used[i] && bucket.hashes[i] == hash) {
+                bucket.values[i] = value;
+                bucket.generations[i] = gen;
+                return;
+            }
+            // empty slots always win, otherwise pick the entry furthest behind the current generation
+            const int age = bucket.used[i] ? static_cast<uint8_t>(gen - bucket.generations[i]) : 256;
+            if (age > oldest) {
+                oldest = age;
+                replace = i;
             }
-            keys.push_back(key);
         }
-        
-        // Insert or update the key in the map
-        table[key] = value;
+        if (!bucket.used[replace]) {
+            bucket.used[replace] = true;
+            filled.fetch_add(1, std::memory_order_relaxed);
+        }
+        bucket.hashes[replace] = hash;
+        bucket.values[replace] = value;
+        bucket.generations[replace] = gen;
     }
 
-    V getHash(const K key) {
-        // REMOVED FOR PERFORMANCE
-        // std::unique_lock<std::mutex> lock(guard);
-        // auto it = std::find(keys.begin(), keys.end(), key);
-        // if (it != keys.end()) {
-        //     // Move the key to the end to mark it as recently used
-        //     keys.erase(it);
-        //     keys.push_back(key);
-        // }
-        return table[key];
+    /*
+        @return true and copies the stored value into out if key is present
+        @param key: position hash
+        @param out: destination for the stored value
+    */
+    bool probe(const K key, V& out) {
+        const uint64_t hash = std::hash<K>{}(key);
+        Bucket& bucket = buckets[hash & mask];
+        std::lock_guard<SpinLock> guard(bucket.lock);
+        for (int i = 0; i < SLOTS; ++i) {
+            if (bucket.used[i] && bucket.hashes[i] == hash) {
+                // refresh so positions still in use survive replacement
+                bucket.generations[i] = generation.load(std::memory_order_relaxed);
+                out = bucket.values[i];
+                return true;
+            }
+        }
+        return false;
     }
 
-    bool contains(const K key) const {
-        return table.find(key) != table.end();
+    // ages every stored entry by one search, called when a new search starts
+    void new_generation() {
+        generation.fetch_add(1, std::memory_order_relaxed);
     }
 
     inline size_t size() const {
-        return table.size();
+        return filled.load(std::memory_order_relaxed);
     }
 
+    // @param size: memory budget in bytes, rounded down to a power of two number of buckets
     void set_size(size_t size) {
-        reserved_size = size;
-        max_elements = static_cast<size_t>(reserved_size / (sizeof(K) + sizeof(V)));
+        size_t bucket_count = 1;
+        while (bucket_count * 2 * sizeof(Bucket) <= size) {
+            bucket_count *= 2;
+        }
+        buckets = std::make_unique<Bucket[]>(bucket_count);
+        mask = bucket_count - 1;
+        filled.store(0, std::memory_order_relaxed);
+        reserved_size = bucket_count * sizeof(Bucket);
+        max_elements = bucket_count * SLOTS;
     }
     size_t max_elements = 0;
 private:
-    std::unordered_map<K, V> table;
-    std::list<K> keys;
-    std::mutex guard;
+    struct Bucket {
+        alignas(64) SpinLock lock;
+        uint64_t hashes[SLOTS] = {};
+        uint8_t generations[SLOTS] = {};
+        bool used[SLOTS] = {};
+        alignas(64) V values[SLOTS];
+    };
+
+    std::unique_ptr<Bucket[]> buckets;
+    size_t mask = 0;
+    std::atomic<size_t> filled = 0;
+    std::atomic<uint8_t> generation = 0;
     size_t reserved_size = 0;
 };
+
+/*
+    Cached network evaluation packed into a single cache line. The value is stored as 16 bit fixed
+    point, priors of the MAX_MOVES most likely moves as (16 bit move, 8 bit prior) pairs. Priors are
+    quantized on a square root scale so small probabilities keep their resolution, the mass of any
+    moves that did not fit is spread evenly over them.
+*/
+struct alignas(64) CompactEval {
+    static constexpr int MAX_MOVES = 20;
+
+    int16_t quantized_value = 0;
+    uint8_t count = 0;
+    uint8_t uncached = 0;
+    uint16_t moves[MAX_MOVES] = {};
+    uint8_t priors[MAX_MOVES] = {};
+
+    CompactEval() {}
+    CompactEval(const std::unordered_map<chess::Move, float>& move_map, float value) {
+        std::vector<std::pair<float, uint16_t>> sorted;
+        sorted.reserve(move_map.size());
+        for (const auto& move : move_map) {
+            sorted.emplace_back(move.second, move.first.move());
+        }
+        store(sorted, value);
+    }
+
+    // @param edges: edges of an expanded node, their priors are cached
+    CompactEval(const Edge* edges, const uint16_t num_edges, float value) {
+        std::vector<std::pair<float, uint16_t>> sorted;
+        sorted.reserve(num_edges);
+        for (uint16_t i = 0; i < num_edges; ++i) {
+            sorted.emplace_back(edges[i].policy, edges[i].move.move());
+        }
+        store(sorted, value);
+    }
+
+    inline float value() const {
+        return static_cast<float>(quantized_value) / 32767.0f;
+    }
+
+    inline float prior(const chess::Move move) const {
+        for (int i = 0; i < count; ++i) {
+            if (moves[i] == move.move()) return dequantize(priors[i]);
+        }
+        return dequantize(uncached);
+    }
+
+    std::unordered_map<chess::Move, float> toMoveMap(const chess::Movelist& movelist) const {
+        std::unordered_map<chess::Move, float> move_map;
+        for (const auto& move : movelist) {
+            move_map[move] = prior(move);
+        }
+        return move_map;
+    }
+
+    private:
+    // @param sorted: (prior, move) pairs, reordered to keep the most likely moves
+    void store(std::vector<std::pair<float, uint16_t>>& sorted, const float value) {
+        quantized_value = static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+        const int stored = std::min(static_cast<int>(sorted.size()), MAX_MOVES);
+        std::partial_sort(sorted.begin(), sorted.begin() + stored, sorted.end(), std::greater<>());
+        float remaining = 1.0f;
+        for (int i = 0; i < stored; ++i) {
+            moves[i] = sorted[i].second;
+            priors[i] = quantize(sorted[i].first);
+            remaining -= sorted[i].first;
+        }
+        count = stored;
+        if (sorted.size() > static_cast<size_t>(stored)) {
+            uncached = quantize(std::max(remaining, 0.0f) / static_cast<float>(sorted.size() - stored));
+        }
+    }
+
+    static inline uint8_t quantize(const float p) {
+        return static_cast<uint8_t>(std::lround(std::sqrt(std::clamp(p, 0.0f, 1.0f)) * 255.0f));
+    }
+
+    static inline float dequantize(const uint8_t q) {
+        const float root = static_cast<float>(q) / 255.0f;
+        return root * root;
+    }
+};
+
+using EvalTable = TranspositionTable<uint64_t, CompactEval>;
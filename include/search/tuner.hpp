@@ -0,0 +1,49 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "include/search/search.hpp"
+#include "include/model/evaluator.hpp"
+
+// search settings a sweep tries, every combination of the three is measured
+struct TuningGrid {
+    std::vector<unsigned int> batch_sizes = {16, 32, 64, 128, 256};
+    std::vector<unsigned int> search_threads;
+    std::vector<unsigned int> inference_executors;
+
+    // @return Grid with thread counts doubling up to the host's hardware threads
+    static TuningGrid forHost();
+};
+
+// measurements of one combination over all tuning positions
+struct TuningResult {
+    unsigned int batch_size = 0;
+    unsigned int search_threads = 0;
+    unsigned int inference_executors = 0;
+    double evals_per_second = 0.0;
+    double simulations_per_second = 0.0;
+    std::chrono::microseconds p50_latency{0};
+    std::chrono::microseconds p99_latency{0};
+};
+
+/*
+    Measures the search with an evaluator on this host for every combination of a grid and keeps
+    the fastest, by simulations per second. Each combination searches the same positions from an
+    empty tree and transposition table, and gets an executor pool of its own.
+*/
+class Tuner {
+public:
+    Tuner(const model::Evaluator& evaluator, const std::vector<std::string>& positions, unsigned int simulations);
+
+    std::vector<TuningResult> run(const TuningGrid& grid);
+    void apply(const TuningResult& result) const;
+    bool save(const TuningResult& result, const std::string& path) const;
+
+private:
+    TuningResult measure(unsigned int batch_size, unsigned int search_threads, unsigned int executors);
+
+    const model::Evaluator& evaluator;
+    const std::vector<std::string> positions;
+    const unsigned int simulations;
+    std::vector<TuningResult> results;
+};
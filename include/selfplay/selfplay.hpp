@@ -17,13 +17,12 @@ struct SelfPlay {
 
     size_t ttable_size;
 
-    torch::jit::script::Module& nnet;
-    torch::Device device;
+    const model::Evaluator& evaluator;
 
     std::mutex indexMutex;
-    TranspositionTable<uint64_t, std::pair<std::unordered_map<chess::Move, float>, float>> transposition_table;
+    EvalTable transposition_table;
     
-    SelfPlay(int total_games, int sims_per_move, unsigned int threads, float resign_threshold, int nn_cache_size, bool trust_val, torch::jit::script::Module& nnet, torch::Device device, size_t ttable_size, float temperature_start);
+    SelfPlay(int total_games, int sims_per_move, unsigned int threads, float resign_threshold, int nn_cache_size, bool trust_val, const model::Evaluator& evaluator, size_t ttable_size, float temperature_start);
     void selfPlayGame();
     void run();
     inline int getGameIndex();
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#if defined(__AVX512BW__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace bit_unpack {
+
+    // bit patterns of 1.0 in the 16 bit float formats
+    constexpr uint16_t HALF_ONE = 0x3C00;
+    constexpr uint16_t BFLOAT16_ONE = 0x3F80;
+    constexpr uint32_t FLOAT_ONE = 0x3F800000;
+
+    // instruction set each width of unpack64 was built for, picked by NARCHESSER_ARCH in CMakeLists.txt
+#if defined(__AVX512BW__)
+    constexpr const char* PATH16 = "avx512bw";
+#elif defined(__AVX2__)
+    constexpr const char* PATH16 = "avx2";
+#else
+    constexpr const char* PATH16 = "portable";
+#endif
+#if defined(__AVX512F__)
+    constexpr const char* PATH32 = "avx512f";
+#elif defined(__AVX2__)
+    constexpr const char* PATH32 = "avx2";
+#else
+    constexpr const char* PATH32 = "portable";
+#endif
+
+    /*
+        Expands the 64 bits of a bitboard into 64 16 bit values, bit i becomes out[i]
+        @param bits: bitboard to expand
+        @param out: 64 values, written whole so a reused buffer needs no clearing
+        @param one: bit pattern written for a set bit, clear bits become 0
+    */
+    inline void unpack64(const uint64_t bits, uint16_t* out, const uint16_t one) {
+#if defined(__AVX512BW__)
+        // one masked move per 32 squares
+        const __m512i ones = _mm512_set1_epi16(static_cast<short>(one));
+        _mm512_storeu_si512(out, _mm512_maskz_mov_epi16(static_cast<__mmask32>(bits), ones));
+        _mm512_storeu_si512(out + 32, _mm512_maskz_mov_epi16(static_cast<__mmask32>(bits >> 32), ones));
+#elif defined(__AVX2__)
+        // each lane tests its own bit of a broadcast 16 bit chunk
+        const __m256i lane_bits = _mm256_setr_epi16(0x0001, 0x0002, 0x0004, 0x0008, 0x0010, 0x0020, 0x0040, 0x0080,
+                                                    0x0100, 0x0200, 0x0400, 0x0800, 0x1000, 0x2000, 0x4000, static_cast<short>(0x8000));
+        const __m256i ones = _mm256_set1_epi16(static_cast<short>(one));
+        for (int chunk = 0; chunk < 4; ++chunk) {
+            const __m256i broadcast = _mm256_set1_epi16(static_cast<short>(bits >> (16 * chunk)));
+            const __m256i set = _mm256_cmpeq_epi16(_mm256_and_si256(broadcast, lane_bits), lane_bits);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 16 * chunk), _mm256_and_si256(set, ones));
+        }
+#else
+        // the multiply moves bit i of a nibble to bit 16 * i, the four products never overlap so nothing carries
+        for (int nibble = 0; nibble < 16; ++nibble) {
+            const uint64_t spread = (((bits >> (4 * nibble)) & 0xF) * 0x0000200040008001ULL) & 0x0001000100010001ULL;
+            const uint64_t lanes = spread * one;
+            std::memcpy(out + 4 * nibble, &lanes, sizeof(lanes));
+        }
+#endif
+    }
+
+    /*
+        Expands the 64 bits of a bitboard into 64 32 bit values, bit i becomes out[i]
+        @param bits: bitboard to expand
+        @param out: 64 values, written whole so a reused buffer needs no clearing
+        @param one: bit pattern written for a set bit, clear bits become 0
+    */
+    inline void unpack64(const uint64_t bits, uint32_t* out, const uint32_t one) {
+#if defined(__AVX512F__)
+        // one masked move per 16 squares
+        const __m512i ones = _mm512_set1_epi32(static_cast<int>(one));
+        for (int chunk = 0; chunk < 4; ++chunk) {
+            _mm512_storeu_si512(out + 16 * chunk, _mm512_maskz_mov_epi32(static_cast<__mmask16>(bits >> (16 * chunk)), ones));
+        }
+#elif defined(__AVX2__)
+        // each lane tests its own bit of a broadcast 8 bit chunk
+        const __m256i lane_bits = _mm256_setr_epi32(0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80);
+        const __m256i ones = _mm256_set1_epi32(static_cast<int>(one));
+        for (int chunk = 0; chunk < 8; ++chunk) {
+            const __m256i broadcast = _mm256_set1_epi32(static_cast<int>((bits >> (8 * chunk)) & 0xFF));
+            const __m256i set = _mm256_cmpeq_epi32(_mm256_and_si256(broadcast, lane_bits), lane_bits);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 8 * chunk), _mm256_and_si256(set, ones));
+        }
+#else
+        // the multiply moves bit 1 of a pair to bit 32, the two products never overlap so nothing carries
+        for (int pair = 0; pair < 32; ++pair) {
+            const uint64_t spread = (((bits >> (2 * pair)) & 0x3) * 0x0000000080000001ULL) & 0x0000000100000001ULL;
+            const uint64_t lanes = spread * one;
+            std::memcpy(out + 2 * pair, &lanes, sizeof(lanes));
+        }
+#endif
+    }
+
+}
@@ -0,0 +1,332 @@
+import argparse
+import copy
+import math
+import os
+import struct
+import time
+import torch
+import torch.nn.functional as F
+from torch import nn
+from model import TransformerNet, InputEmbedding, MultiHeadAttention, PolicyHead, load_transformer, config_from_state_dict
+
+# Inference graph of a TransformerNet for the engine. Everything that depends only on the weights and
+# the constant attention maps is computed once here instead of on every forward:
+#   - the attention map's share of InputEmbedding.linear1 becomes a per-square bias, no map is repeated or concatenated
+#   - PolicyHead's queries, q_linear of the map, become a buffer
+#   - the 1 / sqrt(dk) attention scale is folded into the query weights, no dk tensor is made
+# The graph is scripted, not traced, so the packed input branch and the dtype casts survive the
+# engine converting the model to half or bfloat16.
+#
+#   python export.py <checkpoint or engine model> <models>/current_model/model.pt
+#
+# Keep the model exported from, the graph written cannot be loaded back as a TransformerNet, so later
+# exports and model/quantize.py start from that model.
+#
+# --native also writes the inference graph's weights for the engine's libtorch free cpu backend,
+# include/native/network.hpp, which loads <models>/current_model/native/network.bin. The file is read
+# back and run through native_reference, the backend's forward pass, before it is saved.
+
+
+class InferenceEmbedding(nn.Module):
+    def __init__(self, source: InputEmbedding) -> None:
+        super(InferenceEmbedding, self).__init__()
+        self.input_dim = source.input_dim
+        self.seq_len = source.seq_len
+        self.embedding = source.embedding
+        self.layerNorm1 = source.layerNorm1
+        self.relu1 = source.relu1
+        # linear1 of [x, map] is linear1's x columns applied to x plus its map columns applied to the constant map
+        width = source.linear1.in_features - source.attention_map.shape[-1]
+        weight = source.linear1.weight.detach()
+        self.linear1 = nn.Linear(width, source.linear1.out_features, bias=False)
+        self.linear1.weight = nn.Parameter(weight[:, :width].clone())
+        self.register_buffer('map_bias', source.attention_map @ weight[:, width:].t() + source.linear1.bias.detach())
+        self.layerNorm2 = source.layerNorm2
+        self.relu2 = source.relu2
+
+    def forward(self, x: torch.Tensor) -> torch.Tensor:
+        x = x.reshape(x.size(0), self.seq_len, self.input_dim)
+        x = torch.cat((x, self.embedding(x)), dim=-1)
+        x = self.relu1(self.layerNorm1(x))
+        x = self.linear1(x) + self.map_bias
+        return self.relu2(self.layerNorm2(x))
+
+
+class InferenceAttention(nn.Module):
+    def __init__(self, source: MultiHeadAttention) -> None:
+        super(InferenceAttention, self).__init__()
+        self.seq_len = source.seq_len
+        self.num_heads = source.num_heads
+        self.head_dim = source.head_dim
+        # each head's output rows are [q, k, v], its q rows absorb the attention scale
+        self.qkv_linear = copy.deepcopy(source.qkv_linear)
+        scale = torch.ones(source.num_heads, 3, source.head_dim)
+        scale[:, 0] = 1.0 / math.sqrt(source.head_dim)
+        with torch.no_grad():
+            self.qkv_linear.weight.mul_(scale.reshape(-1, 1))
+            self.qkv_linear.bias.mul_(scale.reshape(-1))
+        self.out_linear = source.out_linear
+        self.p_enc = source.p_enc
+
+    def forward(self, x: torch.Tensor) -> torch.Tensor:
+        qkv = self.qkv_linear(x).view(-1, self.seq_len, self.num_heads, 3 * self.head_dim).permute(0, 2, 1, 3)
+        q, k, v = qkv.chunk(3, dim=-1)
+        attention = F.softmax(torch.matmul(q, k.transpose(-2, -1)) + self.p_enc(x), dim=-1)
+        out = torch.matmul(attention, v)
+        out = out.permute(0, 2, 1, 3).reshape(-1, self.seq_len, self.head_dim * self.num_heads)
+        return self.out_linear(out)
+
+
+class InferencePolicyHead(nn.Module):
+    def __init__(self, source: PolicyHead) -> None:
+        super(InferencePolicyHead, self).__init__()
+        self.seq_len = source.seq_len
+        self.num_heads = source.num_heads
+        self.head_dim = source.head_dim
+        # the queries only see the constant map, one scaled set per head serves every batch
+        with torch.no_grad():
+            query = source.q_linear(source.attention_map)
+        query = query.view(self.seq_len, self.num_heads, self.head_dim).permute(1, 0, 2) / math.sqrt(self.head_dim)
+        self.register_buffer('query', query.contiguous())
+        self.kv_linear = source.kv_linear
+        self.p_enc = source.p_enc
+        self.out_linear = source.out_linear
+        self.layerNorm = source.layerNorm
+        self.relu = source.relu
+        self.policy_linear = source.policy_linear
+        self.flatten_map = source.flatten_map
+
+    def forward(self, x: torch.Tensor) -> torch.Tensor:
+        batch_size = x.size(0)
+        residual = x
+        kv = self.kv_linear(x).view(batch_size, self.seq_len, self.num_heads, 2 * self.head_dim).permute(0, 2, 1, 3)
+        k, v = kv.chunk(2, dim=-1)
+        attention = F.softmax(torch.matmul(self.query, k.transpose(-2, -1)) + self.p_enc(x), dim=-1)
+        out = torch.matmul(attention, v)
+        out = out.permute(0, 2, 1, 3).reshape(batch_size, self.seq_len, self.head_dim * self.num_heads)
+        out = self.out_linear(out) + residual
+        out = self.relu(self.layerNorm(out))
+        return self.flatten_map(self.policy_linear(out))
+
+
+def inference_net(net: TransformerNet) -> TransformerNet:
+    # a copy of net with the inference modules swapped in, net itself is left as it was
+    exported = copy.deepcopy(net).eval()
+    exported.input_embedding = InferenceEmbedding(exported.input_embedding)
+    for block in exported.attentionBlocks:
+        block.multi_head_attention = InferenceAttention(block.multi_head_attention)
+    exported.policy_head = InferencePolicyHead(exported.policy_head)
+    return exported
+
+
+NATIVE_MAGIC = b'NNET'
+NATIVE_VERSION = 1
+NATIVE_CONFIG = ('input_dim', 'seq_len', 'position_embedding_dim', 'embedding_dim', 'hidden_layers', 'attention_dim', 'attention_heads',
+                 'positional_encoding_dim', 'dim_feedforward', 'value_model_dim', 'policy_model_dim', 'policy_out_dim')
+
+
+def native_tensors(exported: TransformerNet) -> list:
+    # weights of an inference_net in the order the native backend reads them, Linear weights stay out x in
+    def linear(layer: nn.Linear) -> list:
+        return [layer.weight] if layer.bias is None else [layer.weight, layer.bias]
+
+    def norm(layer: nn.LayerNorm) -> list:
+        return [layer.weight, layer.bias]
+
+    def encoding(p_enc: nn.Module) -> list:
+        return linear(p_enc.p_enc) + norm(p_enc.layerNorm1) + linear(p_enc.linear) + norm(p_enc.layerNorm2) + linear(p_enc.p_dec)
+
+    embedding = exported.input_embedding
+    tensors = linear(embedding.embedding) + norm(embedding.layerNorm1) + linear(embedding.linear1) + [embedding.map_bias] + norm(embedding.layerNorm2)
+    for block in exported.attentionBlocks:
+        attention = block.multi_head_attention
+        tensors += linear(attention.qkv_linear) + encoding(attention.p_enc) + linear(attention.out_linear) + norm(block.layerNorm1)
+        tensors += linear(block.linear1) + linear(block.linear2) + norm(block.layerNorm2)
+    value = exported.value_head
+    tensors += linear(value.linear1) + linear(value.linear2) + linear(value.linear3)
+    policy = exported.policy_head
+    tensors += [policy.query] + linear(policy.kv_linear) + encoding(policy.p_enc) + linear(policy.out_linear) + norm(policy.layerNorm)
+    return tensors + linear(policy.policy_linear)
+
+
+def save_native(net: TransformerNet, exported: TransformerNet, path: str) -> None:
+    # a header of the magic, the version and the network's shape, then each tensor as its float count and its little endian floats
+    config = config_from_state_dict(net.state_dict())
+    os.makedirs(os.path.dirname(path) or '.', exist_ok=True)
+    with open(path, 'wb') as file:
+        file.write(NATIVE_MAGIC + struct.pack('<I', NATIVE_VERSION))
+        file.write(struct.pack(f'<{len(NATIVE_CONFIG)}I', *(config[key] for key in NATIVE_CONFIG)))
+        for tensor in native_tensors(exported):
+            values = tensor.detach().float().contiguous().flatten()
+            file.write(struct.pack('<I', values.numel()))
+            file.write(values.numpy().astype('<f4').tobytes())
+
+
+def load_native(path: str) -> tuple:
+    # the network shape and the flat tensors of a file written by save_native, read the way the native backend reads it
+    with open(path, 'rb') as file:
+        data = file.read()
+    if data[:4] != NATIVE_MAGIC or struct.unpack_from('<I', data, 4)[0] != NATIVE_VERSION:
+        raise ValueError(f'{path} is not a version {NATIVE_VERSION} native weight file')
+    offset = 8
+    config = dict(zip(NATIVE_CONFIG, struct.unpack_from(f'<{len(NATIVE_CONFIG)}I', data, offset)))
+    offset += 4 * len(NATIVE_CONFIG)
+    tensors = []
+    while offset < len(data):
+        count = struct.unpack_from('<I', data, offset)[0]
+        offset += 4
+        if offset + 4 * count > len(data):
+            raise ValueError(f'{path} ends inside a tensor')
+        tensors.append(torch.frombuffer(bytearray(data[offset:offset + 4 * count]), dtype=torch.float32))
+        offset += 4 * count
+    return config, tensors
+
+
+@torch.no_grad()
+def native_reference(config: dict, tensors: list, positions: torch.Tensor) -> tuple:
+    # the native backend's forward pass written out over the tensors of a native weight file, consumed in file order
+    stream = iter(tensors)
+    squares, heads = config['seq_len'], config['attention_heads']
+    width, encoding_dim = config['embedding_dim'], config['positional_encoding_dim']
+
+    def take(*shape: int) -> torch.Tensor:
+        tensor = next(stream, None)
+        if tensor is None or tensor.numel() != math.prod(shape):
+            raise ValueError('native weights do not match the shape in their header')
+        return tensor.reshape(shape)
+
+    def linear(x: torch.Tensor, inputs: int, outputs: int, bias: bool = True) -> torch.Tensor:
+        weight = take(outputs, inputs)
+        return F.linear(x, weight, take(outputs) if bias else None)
+
+    def norm(x: torch.Tensor, size: int) -> torch.Tensor:
+        weight = take(size)
+        return F.layer_norm(x, (size,), weight, take(size))
+
+    def encoding(x: torch.Tensor) -> torch.Tensor:
+        # attention bias of every head, batch x heads x squares x squares
+        e = norm(linear(x, width, encoding_dim), encoding_dim)
+        e = linear(e, encoding_dim, heads * encoding_dim).view(x.size(0), squares, heads, encoding_dim).permute(0, 2, 1, 3)
+        return linear(norm(e, encoding_dim), encoding_dim, squares)
+
+    def attention(q: torch.Tensor, k: torch.Tensor, v: torch.Tensor, bias: torch.Tensor) -> torch.Tensor:
+        out = torch.matmul(F.softmax(torch.matmul(q, k.transpose(-2, -1)) + bias, dim=-1), v)
+        return out.permute(0, 2, 1, 3).reshape(v.size(0), squares, -1)
+
+    batch = positions.size(0)
+    x = positions.reshape(batch, squares, config['input_dim']).float()
+    x = torch.cat((x, linear(x, config['input_dim'], config['position_embedding_dim'])), dim=-1)
+    x = F.relu(norm(x, x.size(-1)))
+    x = linear(x, x.size(-1), width, bias=False) + take(squares, width)
+    x = F.relu(norm(x, width))
+    head_dim = config['attention_dim'] // heads
+    for _ in range(config['hidden_layers']):
+        qkv = linear(x, width, 3 * config['attention_dim']).view(batch, squares, heads, 3 * head_dim).permute(0, 2, 1, 3)
+        q, k, v = qkv.chunk(3, dim=-1)
+        out = attention(q, k, v, encoding(x))
+        x = norm(linear(out, config['attention_dim'], width) + x, width)
+        x = norm(linear(F.relu(linear(x, width, config['dim_feedforward'])), config['dim_feedforward'], width) + x, width)
+
+    value_dim = config['value_model_dim']
+    value = F.relu(linear(x, width, value_dim)).reshape(batch, squares * value_dim)
+    value = torch.tanh(linear(F.relu(linear(value, squares * value_dim, squares)), squares, 1)).reshape(batch)
+
+    policy_dim = config['policy_model_dim']
+    head_dim = policy_dim // heads
+    query = take(heads, squares, head_dim)
+    k, v = linear(x, width, 2 * policy_dim).view(batch, squares, heads, 2 * head_dim).permute(0, 2, 1, 3).chunk(2, dim=-1)
+    out = attention(query, k, v, encoding(x))
+    out = F.relu(norm(linear(out, policy_dim, width) + x, width))
+    policy = linear(out, width, config['policy_out_dim']).reshape(batch, -1)
+    if next(stream, None) is not None:
+        raise ValueError('native weights hold more tensors than their header describes')
+    return policy, value
+
+
+@torch.no_grad()
+def verify_native(exported: nn.Module, path: str, positions: torch.Tensor, tolerance: float) -> bool:
+    # the written file read back and run through native_reference, against the exported graph
+    config, tensors = load_native(path)
+    native_policy, native_value = native_reference(config, tensors, positions)
+    policy, value = exported(positions)
+    error = max((native_policy - policy.reshape(native_policy.shape)).abs().max().item(), (native_value - value.reshape(-1)).abs().max().item())
+    print(f'largest native weights difference: {error:.2e}')
+    return error <= tolerance
+
+
+def sample_positions(planes: int, count: int, games: str) -> torch.Tensor:
+    if games:
+        from selfplay_data import load_positions
+        return torch.from_numpy(load_positions(games, planes, count)[0])
+    # a quarter of the squares set, like sparse piece planes
+    generator = torch.Generator().manual_seed(0)
+    bits = torch.rand(count, planes, 8, 8, generator=generator) < 0.25
+    return bits.float()
+
+
+def pack(positions: torch.Tensor) -> torch.Tensor:
+    # one int64 bitboard per plane, the engine's packed input
+    bits = positions.reshape(positions.size(0), positions.size(1), 64).long()
+    return (bits << torch.arange(64, dtype=torch.int64)).sum(-1)
+
+
+@torch.no_grad()
+def seconds_per_batch(net: nn.Module, positions: torch.Tensor, runs: int = 10) -> float:
+    for _ in range(2):
+        net(positions)
+    start = time.perf_counter()
+    for _ in range(runs):
+        net(positions)
+    return (time.perf_counter() - start) / runs
+
+
+@torch.no_grad()
+def verify(reference: nn.Module, exported: nn.Module, positions: torch.Tensor, tolerance: float) -> bool:
+    reference_policy, reference_value = reference(positions)
+    policy, value = exported(positions)
+    packed_policy, packed_value = exported(pack(positions))
+    policy_error = (policy - reference_policy).abs().max().item()
+    value_error = (value - reference_value).abs().max().item()
+    packed_error = max((packed_policy - policy).abs().max().item(), (packed_value - value).abs().max().item())
+    print(f'largest policy logit difference: {policy_error:.2e}')
+    print(f'largest value difference: {value_error:.2e}')
+    print(f'largest packed input difference: {packed_error:.2e}')
+    return max(policy_error, value_error, packed_error) <= tolerance
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description='Export a TransformerNet as an inference graph for the engine.')
+    parser.add_argument('model', help='state dict or TorchScript TransformerNet, not an earlier export')
+    parser.add_argument('output', help='path of the exported TorchScript model')
+    parser.add_argument('--games', default='', help='selfplay_games directory to verify on, random positions if not given')
+    parser.add_argument('--positions', type=int, default=256)
+    parser.add_argument('--tolerance', type=float, default=1e-4, help='largest fp32 difference to the training model allowed')
+    parser.add_argument('--native', default='', help='also write the weights for the native cpu backend to this path')
+    args = parser.parse_args()
+
+    net = load_transformer(args.model)
+    planes = net.input_embedding.input_dim * net.input_embedding.seq_len // 64
+    inference = inference_net(net)
+    exported = torch.jit.script(inference)
+    positions = sample_positions(planes, args.positions, args.games)
+
+    if not verify(net, exported, positions, args.tolerance):
+        raise SystemExit('exported graph differs from the training model, not saved')
+    reference_time = seconds_per_batch(torch.jit.script(net), positions)
+    exported_time = seconds_per_batch(exported, positions)
+    print(f'fp32 cpu batch of {len(positions)}: {reference_time * 1000:.2f} ms scripted, {exported_time * 1000:.2f} ms exported')
+    torch.jit.save(exported, args.output)
+    print(f'saved {args.output}')
+    if args.native:
+        # written next to its destination and only moved there once it reproduces the exported graph
+        staging = args.native + '.tmp'
+        save_native(net, inference, staging)
+        if not verify_native(exported, staging, positions, args.tolerance):
+            os.remove(staging)
+            raise SystemExit('native weights differ from the exported graph, not saved')
+        os.replace(staging, args.native)
+        print(f'saved {args.native}')
+
+
+if __name__ == '__main__':
+    main()
@@ -88,6 +88,19 @@ class MultiHeadAttentionModule(nn.Module):
         return x
 
 
+class BitUnpack(nn.Module):
+    def __init__(self) -> None:
+        super(BitUnpack, self).__init__()
+        # not saved with the weights, checkpoints from before packed input still load
+        self.register_buffer('shifts', torch.arange(64, dtype=torch.int64), persistent=False)
+
+    def forward(self, x: torch.Tensor, dtype: torch.dtype) -> torch.Tensor:
+        # x holds one bitboard per plane, bit i of a plane is square (i // 8, i % 8)
+        batch_size, planes = x.size()
+        bits = (x.unsqueeze(-1) >> self.shifts) & 1
+        return bits.view(batch_size, planes, 8, 8).to(dtype)
+
+
 class InputEmbedding(nn.Module):
     def __init__(self, input_dim: int, position_embedding_dim: int, out_embedding_dim: int, seq_len: int, attention_map: torch.Tensor) -> None:
         super(InputEmbedding, self).__init__()
@@ -205,6 +218,7 @@ class TransformerNet(nn.Module):
         super(TransformerNet, self).__init__()
         attention_map = torch.tensor(pam.get_attention_map(), dtype=torch.float32)
 
+        self.bit_unpack = BitUnpack()
         self.input_embedding = InputEmbedding(input_dim, position_embedding_dim, embedding_dim, seq_len, attention_map)
         self.attentionBlocks = nn.ModuleList(
             [MultiHeadAttentionModule(seq_len, embedding_dim, attention_dim, attention_heads, positional_encoding_dim,
@@ -215,9 +229,49 @@ class TransformerNet(nn.Module):
                                       attention_map)
 
     def forward(self, x: torch.Tensor) -> tuple:
+        if x.dtype == torch.int64:
+            # packed input from the engine, one int64 bitboard per plane
+            x = self.bit_unpack(x, self.input_embedding.embedding.weight.dtype)
         x = self.input_embedding(x)
         for attentionBlock in self.attentionBlocks:
             x = attentionBlock(x)
         value = self.value_head(x)
         policy = self.policy_head(x)
         return policy.squeeze(-1), value.squeeze(-1)
+
+
+def config_from_state_dict(state_dict: dict) -> dict:
+    # constructor arguments of the TransformerNet a state dict was saved from, read off its weight shapes
+    embedding = state_dict['input_embedding.embedding.weight']
+    hidden_layers = len({key.split('.')[1] for key in state_dict if key.startswith('attentionBlocks.')})
+    p_enc = state_dict['attentionBlocks.0.multi_head_attention.p_enc.p_enc.weight']
+    return {
+        'input_dim': embedding.shape[1],
+        'position_embedding_dim': embedding.shape[0],
+        'embedding_dim': state_dict['input_embedding.linear1.weight'].shape[0],
+        'seq_len': state_dict['input_embedding.attention_map'].shape[0],
+        'hidden_layers': hidden_layers,
+        'attention_dim': state_dict['attentionBlocks.0.multi_head_attention.qkv_linear.weight'].shape[0] // 3,
+        'attention_heads': state_dict['attentionBlocks.0.multi_head_attention.p_enc.linear.weight'].shape[0] // p_enc.shape[0],
+        'positional_encoding_dim': p_enc.shape[0],
+        'dim_feedforward': state_dict['attentionBlocks.0.linear1.weight'].shape[0],
+        'value_model_dim': state_dict['value_head.linear1.weight'].shape[0],
+        'policy_model_dim': state_dict['policy_head.q_linear.weight'].shape[0],
+        'policy_out_dim': state_dict['policy_head.policy_linear.weight'].shape[0],
+    }
+
+
+def load_transformer(path: str) -> TransformerNet:
+    # fp32 TransformerNet from an engine TorchScript file or a saved state dict, the architecture is read off the weight shapes
+    try:
+        state_dict = torch.jit.load(path, map_location='cpu').state_dict()
+    except RuntimeError:
+        state_dict = torch.load(path, map_location='cpu')
+    if 'input_embedding.map_bias' in state_dict:
+        # export.py folds the attention maps and the policy queries into the weights, they cannot be unfolded
+        raise ValueError(f'{path} is an inference graph written by export.py, load the model it was exported from instead')
+    net = TransformerNet(**config_from_state_dict(state_dict))
+    # the unpack shifts are rebuilt by the constructor, every other key has to match
+    state_dict = {key: value.float() if value.is_floating_point() else value for key, value in state_dict.items() if key != 'bit_unpack.shifts'}
+    net.load_state_dict(state_dict)
+    return net.float().eval()
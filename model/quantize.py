@@ -0,0 +1,93 @@
+import argparse
+import torch
+from torch import nn
+from torch.ao import quantization
+from model import TransformerNet, MultiHeadAttentionModule, load_transformer
+from selfplay_data import load_positions
+
+# int8 variant of an engine model for cpu inference. The attention and feed-forward Linear layers of
+# every attention block run as int8 kernels whose activation ranges are calibrated on self-play
+# positions, everything else stays fp32. The result loads in the engine with inference_precision=int8.
+#
+# The model is the training one, an inference graph written by export.py cannot be quantized.
+#
+#   python quantize.py <checkpoint or engine model> ../selfplay_games <models>/current_model/int8/model.pt
+
+
+class CalibratedLinear(nn.Module):
+    def __init__(self, linear: nn.Linear) -> None:
+        super(CalibratedLinear, self).__init__()
+        self.quant = quantization.QuantStub()
+        self.linear = linear
+        self.dequant = quantization.DeQuantStub()
+
+    def forward(self, x: torch.Tensor) -> torch.Tensor:
+        return self.dequant(self.linear(self.quant(x)))
+
+
+def wrap_linears(net: TransformerNet, qconfig: quantization.QConfig) -> None:
+    for block in net.attentionBlocks:
+        assert isinstance(block, MultiHeadAttentionModule)
+        attention = block.multi_head_attention
+        attention.qkv_linear = CalibratedLinear(attention.qkv_linear)
+        attention.out_linear = CalibratedLinear(attention.out_linear)
+        block.linear1 = CalibratedLinear(block.linear1)
+        block.linear2 = CalibratedLinear(block.linear2)
+    for module in net.modules():
+        if isinstance(module, CalibratedLinear):
+            module.qconfig = qconfig
+
+
+@torch.no_grad()
+def run(net: nn.Module, inputs: torch.Tensor, batch_size: int) -> tuple:
+    policies, values = [], []
+    for start in range(0, len(inputs), batch_size):
+        policy, value = net(inputs[start:start + batch_size])
+        policies.append(policy.reshape(policy.shape[0], -1))
+        values.append(value.reshape(-1))
+    return torch.cat(policies), torch.cat(values)
+
+
+def report(reference: tuple, quantized: tuple, search_policies: torch.Tensor) -> None:
+    # top-1 among the moves the search visited, which are legal, so illegal logits cannot decide it
+    visited = search_policies > 0
+    masked_reference = reference[0].masked_fill(~visited, float('-inf'))
+    masked_quantized = quantized[0].masked_fill(~visited, float('-inf'))
+    agreement = (masked_reference.argmax(1) == masked_quantized.argmax(1)).float().mean().item()
+    value_mae = (reference[1] - quantized[1]).abs().mean().item()
+    print(f'policy top-1 agreement with fp32: {agreement * 100:.2f}%')
+    print(f'value MAE against fp32: {value_mae:.4f}')
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description='Quantize an engine model to int8 for cpu inference.')
+    parser.add_argument('model', help='state dict or TorchScript TransformerNet, not an export.py inference graph')
+    parser.add_argument('games', help='selfplay_games directory written by the engine')
+    parser.add_argument('output', help='path of the int8 TorchScript model')
+    parser.add_argument('--positions', type=int, default=4096, help='positions read, half calibrate and half check')
+    parser.add_argument('--batch-size', type=int, default=256)
+    parser.add_argument('--backend', default='fbgemm', help='fbgemm for x86, qnnpack for arm')
+    args = parser.parse_args()
+
+    torch.backends.quantized.engine = args.backend
+    reference_net = load_transformer(args.model)
+    planes = reference_net.input_embedding.input_dim * reference_net.input_embedding.seq_len // 64
+    inputs, search_policies = load_positions(args.games, planes, args.positions)
+    inputs, search_policies = torch.from_numpy(inputs), torch.from_numpy(search_policies)
+    # calibrating and checking on separate positions keeps the check honest
+    split = len(inputs) // 2
+    calibration, check = inputs[:split], inputs[split:]
+
+    net = load_transformer(args.model)
+    wrap_linears(net, quantization.get_default_qconfig(args.backend))
+    quantization.prepare(net, inplace=True)
+    run(net, calibration, args.batch_size)
+    quantization.convert(net, inplace=True)
+
+    report(run(reference_net, check, args.batch_size), run(net, check, args.batch_size), search_policies[split:])
+    torch.jit.save(torch.jit.script(net), args.output)
+    print(f'saved {args.output}')
+
+
+if __name__ == '__main__':
+    main()
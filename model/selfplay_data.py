@@ -0,0 +1,111 @@
+import os
+import numpy as np
+import chess
+import chess.pgn
+
+# planes per position and extra planes, as in include/planes.hpp
+POSITION_PLANES = 14
+EXTRA_PLANES = 6
+POLICY_SIZE = 4672
+PIECE_TYPES = [chess.PAWN, chess.KNIGHT, chess.BISHOP, chess.ROOK, chess.QUEEN, chess.KING]
+FULL = (1 << 64) - 1
+
+
+def history_from_planes(planes: int) -> int:
+    return (planes - EXTRA_PLANES) // POSITION_PLANES
+
+
+def repetitions(keys: list, halfmove_clocks: list, index: int) -> int:
+    # earlier occurrences of position index with the same side to move since the last irreversible move, at most 2
+    count = 0
+    i = index - 2
+    while i >= 0 and i >= index - halfmove_clocks[index] - 1:
+        if keys[i] == keys[index]:
+            count += 1
+            if count == 2:
+                break
+        i -= 2
+    return count
+
+
+def position_planes(board: chess.Board, reps: int) -> list:
+    # planes::toPlane, the side to move's pieces first and ranks mirrored for black
+    color = board.turn
+    planes = []
+    for piece_color in (color, not color):
+        for piece_type in PIECE_TYPES:
+            pieces = board.pieces_mask(piece_type, piece_color)
+            planes.append(chess.flip_vertical(pieces) if color == chess.BLACK else pieces)
+    planes.append(FULL if reps >= 1 else 0)
+    planes.append(FULL if reps >= 2 else 0)
+    return planes
+
+
+def extra_planes(board: chess.Board) -> list:
+    # planes::extraPlanes, the colour plane is left empty by the engine
+    color = board.turn
+    planes = [0]
+    for side in (color, not color):
+        planes.append(FULL if board.has_kingside_castling_rights(side) else 0)
+        planes.append(FULL if board.has_queenside_castling_rights(side) else 0)
+    # the engine only keeps an en passant square an enemy pawn attacks
+    if board.ep_square is not None and board.has_pseudo_legal_en_passant():
+        planes.append(chess.BB_FILES[chess.square_file(board.ep_square)])
+    else:
+        planes.append(0)
+    return planes
+
+
+def unpack(bitboards: list) -> np.ndarray:
+    # bit i of a plane is square (i // 8, i % 8), the layout of the engine's dense input
+    bits = np.array(bitboards, dtype=np.uint64)[:, None] >> np.arange(64, dtype=np.uint64)
+    return (bits & np.uint64(1)).astype(np.float32).reshape(len(bitboards), 8, 8)
+
+
+def encode_game(game: chess.pgn.Game, history: int) -> list:
+    # input planes of every position a move was searched from, in the order of the game's policy.bin rows
+    board = game.board()
+    boards, keys, clocks = [], [], []
+    for move in game.mainline_moves():
+        boards.append(board.copy(stack=False))
+        keys.append(board._transposition_key())
+        clocks.append(board.halfmove_clock)
+        board.push(move)
+
+    encoded = []
+    for index, position in enumerate(boards):
+        bitboards = []
+        for look_back in range(history):
+            earlier = index - look_back
+            if earlier < 0:
+                bitboards.extend([0] * POSITION_PLANES)
+            else:
+                bitboards.extend(position_planes(boards[earlier], repetitions(keys, clocks, earlier)))
+        bitboards.extend(extra_planes(position))
+        encoded.append(unpack(bitboards))
+    return encoded
+
+
+def load_positions(directory: str, planes: int, limit: int) -> tuple:
+    # (inputs [n, planes, 8, 8], search policies [n, 4672]) from the engine's selfplay_games output, games in numeric order
+    history = history_from_planes(planes)
+    games = sorted((entry for entry in os.listdir(directory) if entry.startswith('game-')), key=lambda name: int(name.split('-')[1]))
+    inputs, policies = [], []
+    for name in games:
+        path = os.path.join(directory, name)
+        if not os.path.exists(os.path.join(path, 'game.pgn')) or not os.path.exists(os.path.join(path, 'policy.bin')):
+            continue
+        with open(os.path.join(path, 'game.pgn')) as pgn:
+            game = chess.pgn.read_game(pgn)
+        if game is None:
+            continue
+        positions = encode_game(game, history)
+        policy = np.fromfile(os.path.join(path, 'policy.bin'), dtype=np.float32).reshape(-1, POLICY_SIZE)
+        # policy.bin is appended to, a replayed game index keeps only its last game's rows
+        policy = policy[-len(positions):] if len(positions) else policy[:0]
+        count = min(len(positions), len(policy))
+        inputs.extend(positions[:count])
+        policies.extend(policy[:count])
+        if len(inputs) >= limit:
+            break
+    return np.stack(inputs[:limit]), np.stack(policies[:limit])
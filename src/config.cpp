@@ -1,4 +1,5 @@
 #include "include/config.hpp"
+#include <filesystem>
 #include "include/search/constants.hpp"
 
 void ConfigParser::parseConfigFile(const std::string& filename) {
@@ -51,7 +52,64 @@ void ConfigParser::config_params() {
     cpuct_factor = getValue("cpuct_factor", 2.815f);
     checks_before_move = getValue("checks_before_move", 3);
     growth_before_check = getValue("growth_before_check", 1000);
+    // games self play runs at once, each searches on a single thread
     thread_count = getValue("thread_count", 4);
+    // threads of a single search, used by the human and test games and the tuner
+    search_threads = getValue("search_threads", 4);
     transposition_table_size = getValue("transposition_table_size", 10000000);
+    // batching_profile
+    response = get("batching_profile");
+    batching_profile = response == "" ? "high_throughput" : response;
+    std::cout << "batching_profile: " << batching_profile << '\n';
+    if (batching_profile != "high_throughput" && batching_profile != "low_latency") {
+        std::cerr << "Unknown batching_profile " << batching_profile << ", using high_throughput" << std::endl;
+        batching_profile = "high_throughput";
+    }
+    packed_input = getValue("packed_input", 0);
+    inference_executors = getValue("inference_executors", 1);
+    intra_op_threads = getValue("intra_op_threads", 0);
+    pin_executor_threads = getValue("pin_executor_threads", 0);
+    // inference_precision
+    response = get("inference_precision");
+    inference_precision = response == "" ? "auto" : response;
+    std::cout << "inference_precision: " << inference_precision << '\n';
+    // inference_backend
+    response = get("inference_backend");
+    inference_backend = response == "" ? "libtorch" : response;
+    std::cout << "inference_backend: " << inference_backend << '\n';
+    if (inference_backend != "libtorch" && inference_backend != "native" && inference_backend != "mock") {
+        std::cerr << "Unknown inference_backend " << inference_backend << ", using libtorch" << std::endl;
+        inference_backend = "libtorch";
+    }
+    mock_batch_latency_us = getValue("mock_batch_latency_us", 1000);
+    mock_position_latency_us = getValue("mock_position_latency_us", 0);
+    nn_batch_size = getValue("nn_batch_size", 256);
+    // tuning_profile, written by the tuner, none by default, its settings replace the ones above when set
+    tuning_profile = get("tuning_profile");
+    std::cout << "tuning_profile: " << tuning_profile << '\n';
+    if (tuning_profile.empty()) return;
+    if (std::filesystem::exists(tuning_profile)) {
+        ConfigParser(tuning_profile).tuned_params();
+    }
+    else {
+        std::cerr << "Tuning profile " << tuning_profile << " not found, using params.txt" << std::endl;
+    }
+}
+
+/*
+    Reads the settings a tuning profile holds and prints every one it overrides, a setting missing
+    from it is left as params.txt set it
+*/
+void ConfigParser::tuned_params() {
+    auto tuned = [this](const std::string& key, int& value) {
+        const auto response = get(key);
+        if (response.empty()) return;
+        const int profile_value = std::stoi(response);
+        std::cout << key << ": " << profile_value << " from the tuning profile, params.txt has " << value << '\n';
+        value = profile_value;
+    };
+    tuned("nn_batch_size", nn_batch_size);
+    tuned("search_threads", search_threads);
+    tuned("inference_executors", inference_executors);
 }
 
@@ -1,54 +1,65 @@
 #include "include/model/encoder.hpp"
 
-// Function to encode the state of a chess board into an array of Bitboards
-EncodedState::EncodedState(const Node* node, const std::vector<chess::Board>& traversed, const uint8_t history) : history(history) {
+/*
+    Encodes the positions before the root once, leaves whose history reaches above the root copy them
+    @param traversed: earlier roots of the game, newest last
+*/
+void RootHistory::set(const std::vector<chess::Board>& traversed, const uint8_t history) {
+    positions = static_cast<uint8_t>(std::min<size_t>(traversed.size(), history - 1));
+    for (uint8_t i = 0; i < positions; ++i) {
+        const auto& state = traversed[traversed.size() - 1 - i];
+        planes::toPlane(state, state.sideToMove(), state.repetitionCount(), &planes[i * planes::POSITION_PLANES]);
+    }
+}
 
-    totalPlanes = 14 * history + 6;
-    encodedState = std::make_unique<Bitboard[]>(totalPlanes);
-    auto index = 0;
-    auto a = planes::toPlane(node->state, node->state.sideToMove());
-    for (uint8_t i = 0; i < 14; ++i) {
-        encodedState[index] = a[i];
-        ++index;
+// Function to encode the state of a chess board into an array of Bitboards
+// board is the position of node, history positions inside the tree are reached by unmaking moves on it and restored before returning
+EncodedState::EncodedState(chess::Board& board, const Node* node, const RootHistory& root_history, const uint8_t history)
+    : history(history), totalPlanes(static_cast<uint8_t>(planeCount(history))) {
+    // the history length picks an instantiation whose loop bound is a constant
+    switch (history) {
+        case 1: encode<1>(board, node, root_history); break;
+        case 2: encode<2>(board, node, root_history); break;
+        case 3: encode<3>(board, node, root_history); break;
+        case 4: encode<4>(board, node, root_history); break;
+        case 5: encode<5>(board, node, root_history); break;
+        case 6: encode<6>(board, node, root_history); break;
+        case 7: encode<7>(board, node, root_history); break;
+        default: encode<MAX_HISTORY>(board, node, root_history); break;
     }
-    a.reset();
-    const int num_prevs = node->prev_list.size();
-    const int num_traversed = traversed.size();
-    for (int lookBack = 1; lookBack < history; ++lookBack) {
-        const int lb_amount = num_prevs - lookBack;
-        if (lb_amount < 0) {
-            const auto trav_index = num_traversed + lb_amount;
-            if (trav_index >= 0) {
-                const auto state = traversed[trav_index];
-                auto b = planes::toPlane(state, state.sideToMove());
-                for (uint8_t i = 0; i < 14; ++i) {
-                    encodedState[index] = b[i];
-                    ++index;
-                }
-                b.reset();
+}
+
+template<uint8_t HISTORY>
+void EncodedState::encode(chess::Board& board, const Node* node, const RootHistory& root_history) {
+    static_assert(HISTORY >= 1 && HISTORY <= MAX_HISTORY);
+    Bitboard* plane = encodedState.data();
+    // repetitions come from the position hashes the board keeps for the whole game and path
+    planes::toPlane(board, board.sideToMove(), board.repetitionCount(), plane);
+    plane += planes::POSITION_PLANES;
+    uint8_t above_root = 0;
+    const Node* cursor = node;
+    chess::Movelist unmade;
+    for (int lookBack = 1; lookBack < HISTORY; ++lookBack) {
+        if (cursor->getParent() == nullptr) {
+            // positions above the root come from its precomputed history
+            if (above_root < root_history.positions) {
+                const Bitboard* source = &root_history.planes[above_root++ * planes::POSITION_PLANES];
+                std::copy(source, source + planes::POSITION_PLANES, plane);
             }
             else {
-                auto b = planes::emptyPlane();
-                for (uint8_t i = 0; i < 14; ++i) {
-                    encodedState[index] = b[i];
-                    ++index;
-                }
-                b.reset();
+                planes::emptyPlane(plane);
             }
         }
         else {
-            auto b = planes::toPlane(node->prev_list[lb_amount]->state, node->prev_list[lb_amount]->state.sideToMove());
-            for (uint8_t i = 0; i < 14; ++i) {
-                encodedState[index] = b[i];
-                ++index;
-            }
-            b.reset();
+            board.unmakeMove(cursor->move);
+            unmade.add(cursor->move);
+            cursor = cursor->getParent();
+            planes::toPlane(board, board.sideToMove(), board.repetitionCount(), plane);
         }
+        plane += planes::POSITION_PLANES;
     }
-    auto c = planes::extraPlanes(node->state);
-    for (uint8_t i = 0; i < 6; ++i) {
-        encodedState[index] = c[i];
-        ++index;
+    for (auto it = unmade.rbegin(); it != unmade.rend(); ++it) {
+        board.makeMove(*it);
     }
-    c.reset();
+    planes::extraPlanes(board, plane);
 }
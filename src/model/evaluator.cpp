@@ -0,0 +1,110 @@
+#include <bit>
+#include <cmath>
+#include <thread>
+#include "include/model/evaluator.hpp"
+#include "include/model/executor.hpp"
+
+namespace {
+    // pawn, knight, bishop, rook, queen and king planes of a side, in planes::toPlane order
+    constexpr float PIECE_VALUES[6] = {1.0f, 3.0f, 3.0f, 5.0f, 9.0f, 0.0f};
+    // a queen up is a value of about 0.7
+    constexpr float MATERIAL_SCALE = 0.08f;
+    // largest logit difference between two moves of the mock, priors stay within a factor of e^2
+    constexpr float PRIOR_SPREAD = 2.0f;
+
+    // @return Bitboard of a plane of a slot, read from whichever input format the batch has
+    uint64_t planeBits(model::BatchBuffer& batch, const unsigned int slot, const unsigned int plane) {
+        if (batch.packed) return static_cast<uint64_t>(batch.packedSlot(slot)[plane]);
+        uint64_t bits = 0;
+        if (batch.input_type == torch::kFloat32) {
+            const uint32_t* values = batch.slot<uint32_t>(slot) + plane * 64;
+            for (int i = 0; i < 64; ++i) bits |= static_cast<uint64_t>(values[i] != 0) << i;
+        } else {
+            const uint16_t* values = batch.slot<uint16_t>(slot) + plane * 64;
+            for (int i = 0; i < 64; ++i) bits |= static_cast<uint64_t>(values[i] != 0) << i;
+        }
+        return bits;
+    }
+
+    // splitmix64 finalizer, spreads a key over all 64 bits
+    inline uint64_t mix(uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31);
+    }
+}
+
+namespace model {
+
+    Evaluator::~Evaluator() {
+        releaseExecutors(*this);
+    }
+
+    TorchEvaluator::TorchEvaluator(const torch::jit::script::Module& module, const torch::Device device, const torch::ScalarType input_type)
+        : module(module), model_device(device), input_type(input_type) {}
+
+    void TorchEvaluator::evaluate(BatchBuffer& batch) {
+        model::evaluate(batch, module, model_device);
+    }
+
+    std::unique_ptr<Evaluator> TorchEvaluator::clone() const {
+        // a shallow copy is a module of its own whose parameters are the original's tensors
+        auto copy = std::make_unique<TorchEvaluator>(module.copy(), model_device, input_type);
+        if (copy->module.hasattr("training")) copy->module.eval();
+        return copy;
+    }
+
+    NativeEvaluator::NativeEvaluator(std::shared_ptr<const native::Network> network) : network(std::move(network)) {}
+
+    void NativeEvaluator::evaluate(BatchBuffer& batch) {
+        model::evaluate(batch, *network, workspace);
+    }
+
+    // the weights are shared, each clone grows a workspace of its own
+    std::unique_ptr<Evaluator> NativeEvaluator::clone() const {
+        return std::make_unique<NativeEvaluator>(network);
+    }
+
+    MockEvaluator::MockEvaluator(const std::chrono::microseconds batch_latency, const std::chrono::microseconds position_latency)
+        : batch_latency(batch_latency), position_latency(position_latency) {}
+
+    void MockEvaluator::evaluate(BatchBuffer& batch) {
+        const auto ready = std::chrono::steady_clock::now() + batch_latency + position_latency * batch.size;
+        const int64_t* legal = batch.legal_indices.data_ptr<int64_t>();
+        float* priors = batch.priors_output.data_ptr<float>();
+        float* values = batch.value_output.data_ptr<float>();
+        for (unsigned int slot = 0; slot < batch.size; ++slot) {
+            // the newest position's planes, side to move first, then the opponent
+            float material = 0.0f;
+            uint64_t hash = 0;
+            for (unsigned int plane = 0; plane < 12; ++plane) {
+                const uint64_t bits = planeBits(batch, slot, plane);
+                const float piece = PIECE_VALUES[plane % 6] * static_cast<float>(std::popcount(bits));
+                material += plane < 6 ? piece : -piece;
+                hash = mix(hash ^ bits ^ plane);
+            }
+            values[slot] = std::tanh(material * MATERIAL_SCALE);
+
+            const int64_t* indices = legal + static_cast<size_t>(slot) * MAX_LEGAL_MOVES;
+            float* out = priors + static_cast<size_t>(slot) * MAX_LEGAL_MOVES;
+            float sum = 0.0f;
+            for (unsigned int i = 0; i < MAX_LEGAL_MOVES; ++i) {
+                if (indices[i] < 0) {
+                    out[i] = 0.0f;
+                    continue;
+                }
+                const float unit = static_cast<float>(mix(hash ^ static_cast<uint64_t>(indices[i])) >> 40) / static_cast<float>(1 << 24);
+                out[i] = std::exp(unit * PRIOR_SPREAD);
+                sum += out[i];
+            }
+            if (sum > 0.0f) {
+                for (unsigned int i = 0; i < MAX_LEGAL_MOVES; ++i) out[i] /= sum;
+            }
+        }
+        std::this_thread::sleep_until(ready);
+    }
+
+    std::unique_ptr<Evaluator> MockEvaluator::clone() const {
+        return std::make_unique<MockEvaluator>(batch_latency, position_latency);
+    }
+}
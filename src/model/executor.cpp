@@ -0,0 +1,178 @@
+#include <map>
+#include <memory>
+#include <future>
+#include <climits>
+#include "include/model/executor.hpp"
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+    // pools of the evaluators searches were created with, each kept until its evaluator is destroyed
+    struct Registry {
+        std::mutex lock;
+        std::map<const model::Evaluator*, std::unique_ptr<model::ExecutorPool>> pools;
+    };
+
+    // never destroyed itself, evaluators can outlive it during static destruction
+    Registry& registry() {
+        static Registry* instance = new Registry();
+        return *instance;
+    }
+
+    // pinned executors per core, shared by every pool of the process so their core ranges stay apart
+    struct CoreMap {
+        std::mutex lock;
+        std::vector<unsigned int> users;
+    };
+
+    CoreMap& coreMap() {
+        static CoreMap* instance = new CoreMap();
+        return *instance;
+    }
+
+    /*
+        Reserves count consecutive cores, wrapping past the last one, for a pool's executors
+        @return First core of the range, the one overlapping the fewest cores already taken
+    */
+    unsigned int claimCores(const unsigned int count) {
+        const unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+        CoreMap& map = coreMap();
+        std::lock_guard<std::mutex> guard(map.lock);
+        map.users.resize(cores, 0);
+        unsigned int first = 0;
+        unsigned int fewest = UINT_MAX;
+        for (unsigned int start = 0; start < cores; ++start) {
+            unsigned int taken = 0;
+            for (unsigned int i = 0; i < count; ++i) taken += map.users[(start + i) % cores];
+            if (taken < fewest) {
+                fewest = taken;
+                first = start;
+            }
+        }
+        for (unsigned int i = 0; i < count; ++i) ++map.users[(first + i) % cores];
+        return first;
+    }
+
+    void releaseCores(const unsigned int first, const unsigned int count) {
+        CoreMap& map = coreMap();
+        std::lock_guard<std::mutex> guard(map.lock);
+        for (unsigned int i = 0; i < count; ++i) --map.users[(first + i) % map.users.size()];
+    }
+
+    // Restricts the calling thread, and the intra-op threads it starts later, to cores [first, first + count).
+    void pinCurrentThread(const unsigned int first, const unsigned int count) {
+        const unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+#ifdef _WIN32
+        DWORD_PTR mask = 0;
+        for (unsigned int i = 0; i < count; ++i) mask |= DWORD_PTR(1) << ((first + i) % std::min<unsigned int>(cores, 64));
+        SetThreadAffinityMask(GetCurrentThread(), mask);
+#elif defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (unsigned int i = 0; i < count; ++i) CPU_SET((first + i) % cores, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+        (void)first; (void)count; (void)cores;
+#endif
+    }
+}
+
+namespace model {
+
+    ExecutorPool::ExecutorPool(const Evaluator& evaluator, const ExecutorSettings& settings)
+        : device(evaluator.device()), input_type(evaluator.inputType()), settings(settings) {
+        const unsigned int count = std::max(settings.executors, 1u);
+        if (settings.pin_threads) first_core = claimCores(count * coreWidth());
+        evaluators.reserve(count);
+        for (unsigned int i = 0; i < count; ++i) {
+            evaluators.push_back(evaluator.clone());
+        }
+        for (unsigned int i = 0; i < count; ++i) {
+            threads.emplace_back(&ExecutorPool::run, this, i);
+        }
+    }
+
+    ExecutorPool::~ExecutorPool() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+        }
+        cv.notify_all();
+        for (auto& thread : threads) {
+            if (thread.joinable()) thread.join();
+        }
+        if (settings.pin_threads) releaseCores(first_core, static_cast<unsigned int>(threads.size()) * coreWidth());
+    }
+
+    /*
+        Queues a batch for the next free executor
+        @param done: called on the executor thread once the batch's outputs are written
+    */
+    void ExecutorPool::submit(BatchBuffer& batch, std::function<void()> done) {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            jobs.push(Job{&batch, std::move(done)});
+        }
+        cv.notify_one();
+    }
+
+    // Evaluates a batch on the pool and waits for it.
+    void ExecutorPool::evaluate(BatchBuffer& batch) {
+        std::promise<void> finished;
+        auto result = finished.get_future();
+        submit(batch, [&finished] { finished.set_value(); });
+        result.wait();
+    }
+
+    void ExecutorPool::run(const unsigned int index) {
+        if (settings.intra_op_threads > 0) {
+            // the intra-op thread count is per calling thread with libtorch's OpenMP backend
+            at::set_num_threads(settings.intra_op_threads);
+        }
+        if (settings.pin_threads) {
+            pinCurrentThread(first_core + index * coreWidth(), coreWidth());
+        }
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                cv.wait(guard, [this] { return stopping || !jobs.empty(); });
+                if (jobs.empty()) return;
+                job = std::move(jobs.front());
+                jobs.pop();
+            }
+            evaluators[index]->evaluate(*job.batch);
+            job.done();
+        }
+    }
+
+    /*
+        @return The executor pool of an evaluator, created with settings on first use and shared by
+        every search using that evaluator, so their batches spread over the same executors
+    */
+    ExecutorPool& executorsFor(const Evaluator& evaluator, const ExecutorSettings& settings) {
+        std::lock_guard<std::mutex> guard(registry().lock);
+        auto& pool = registry().pools[&evaluator];
+        if (!pool) pool = std::make_unique<ExecutorPool>(evaluator, settings);
+        return *pool;
+    }
+
+    // Drops the pool of an evaluator being destroyed, every search using it must have ended.
+    void releaseExecutors(const Evaluator& evaluator) {
+        std::unique_ptr<ExecutorPool> pool;
+        {
+            std::lock_guard<std::mutex> guard(registry().lock);
+            auto& pools = registry().pools;
+            auto entry = pools.find(&evaluator);
+            if (entry == pools.end()) return;
+            pool = std::move(entry->second);
+            pools.erase(entry);
+        }
+        // destroyed outside the lock, the clones it holds release their own, absent, pools
+    }
+}
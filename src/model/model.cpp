@@ -1,43 +1,88 @@
 #include "include/model/model.hpp"
+#include "include/utils/bit_unpack.hpp"
 
 namespace model {
-    std::mutex device_lock;
-    std::queue<std::pair<torch::Tensor, torch::Tensor>> evaluate(std::queue<torch::Tensor> inputs_tensor, torch::jit::script::Module module, const torch::Device device) {
-        std::lock_guard<std::mutex> guard(device_lock); // prevents overflowing device on multiple threads
-        torch::NoGradGuard no_grad;
-        module.eval();
-
-        std::vector<torch::Tensor> inputs_vector;
-        inputs_vector.reserve(inputs_tensor.size());
-
-        while (!inputs_tensor.empty()) {
-            inputs_vector.push_back(std::move(inputs_tensor.front()));
-            inputs_tensor.pop();
-        }
+    BatchBuffer::BatchBuffer(unsigned int capacity, unsigned int planes, unsigned int policy_size, const torch::Device device, const bool packed,
+                             const torch::ScalarType input_type)
+        : capacity(capacity), planes(planes), policy_size(policy_size), packed(packed), input_type(input_type) {
+        // page locked input lets the copy to a gpu run asynchronously
+        const auto options = torch::TensorOptions().pinned_memory(device.is_cuda());
+        if (packed) input = torch::zeros({capacity, planes}, options.dtype(torch::kInt64));
+        else input = torch::zeros({capacity, planes, 8, 8}, options.dtype(input_type));
+        legal_indices = torch::zeros({capacity, MAX_LEGAL_MOVES}, options.dtype(torch::kInt64));
+        priors_output = torch::zeros({capacity, MAX_LEGAL_MOVES}, torch::kFloat32);
+        value_output = torch::zeros({capacity}, torch::kFloat32);
+    }
 
-        torch::Tensor batch = torch::stack(inputs_vector, 0).to(device);
+    /*
+        Runs the network on the filled slots of a batch and writes the results into its output tensors.
+        Calls on different modules may run concurrently, see ExecutorPool.
+    */
+    void evaluate(BatchBuffer& batch, torch::jit::script::Module& module, const torch::Device device) {
+        // modules are put in eval mode once where they are set up, frozen ones have no training flag to set
+        torch::NoGradGuard no_grad;
 
-        // Wrap the batch tensor in an IValue before passing it to the model
-        std::vector<torch::jit::IValue> inputs = {batch};
+        const int64_t count = batch.size;
+        // a view of the filled slots, moving it to the cpu device is free
+        std::vector<torch::jit::IValue> inputs = {batch.input.narrow(0, 0, count).to(device, /*non_blocking=*/true)};
 
         auto outputs = module.forward(inputs).toTuple()->elements();
 
-        torch::Tensor policy_output = outputs.at(0).toTensor().to(torch::kCPU);
-        torch::Tensor value_output = outputs.at(1).toTensor().to(torch::kCPU);
-
-        std::queue<std::pair<torch::Tensor, torch::Tensor>> results;
+        // gather each slot's legal logits and softmax them on the device, unlisted entries get no probability
+        auto indices = batch.legal_indices.narrow(0, 0, count).to(device, /*non_blocking=*/true);
+        auto legal = indices.ge(0);
+        auto logits = outputs.at(0).toTensor().reshape({count, batch.policy_size}).gather(1, indices.clamp_min(0)).to(torch::kFloat32);
+        auto priors = logits.masked_fill(legal.logical_not(), -std::numeric_limits<float>::infinity()).softmax(1);
 
-        for (unsigned int i = 0; i < batch.size(0); ++i) {
-            auto individual_policy = policy_output[i];
-            auto individual_value = value_output[i];
+        // one copy per output converts to float and brings the results back to the host
+        batch.priors_output.narrow(0, 0, count).copy_(priors);
+        batch.value_output.narrow(0, 0, count).copy_(outputs.at(1).toTensor().reshape({count}));
+    }
 
-            results.push(std::make_pair(individual_policy, individual_value));
+    /*
+        Runs the native network on the filled slots of a batch, with the same results as the module
+        call above. Packed slots are unpacked to floats here, dense slots must be float.
+    */
+    void evaluate(BatchBuffer& batch, const native::Network& network, native::Workspace& workspace) {
+        const unsigned int count = batch.size;
+        const size_t input_size = static_cast<size_t>(batch.planes) * 64;
+        const float* input;
+        if (batch.packed) {
+            if (workspace.input.size() < count * input_size) workspace.input.resize(count * input_size);
+            for (unsigned int slot = 0; slot < count; ++slot) {
+                const int64_t* bitboards = batch.packedSlot(slot);
+                auto* out = reinterpret_cast<uint32_t*>(workspace.input.data() + slot * input_size);
+                for (unsigned int plane = 0; plane < batch.planes; ++plane) {
+                    bit_unpack::unpack64(static_cast<uint64_t>(bitboards[plane]), out + plane * 64, bit_unpack::FLOAT_ONE);
+                }
+            }
+            input = workspace.input.data();
+        } else {
+            input = batch.slot<float>(0);
         }
 
-        // needed to avoid memory leak!
-        policy_output.reset();
-        value_output.reset();
+        if (workspace.logits.size() < static_cast<size_t>(count) * batch.policy_size) workspace.logits.resize(static_cast<size_t>(count) * batch.policy_size);
+        network.forward(input, static_cast<int>(count), workspace.logits.data(), batch.value_output.data_ptr<float>(), workspace);
 
-        return results;
+        // softmax over each slot's legal logits, unlisted entries get no probability
+        const int64_t* legal = batch.legal_indices.data_ptr<int64_t>();
+        float* priors = batch.priors_output.data_ptr<float>();
+        for (unsigned int slot = 0; slot < count; ++slot) {
+            const int64_t* indices = legal + static_cast<size_t>(slot) * MAX_LEGAL_MOVES;
+            const float* logits = workspace.logits.data() + static_cast<size_t>(slot) * batch.policy_size;
+            float* out = priors + static_cast<size_t>(slot) * MAX_LEGAL_MOVES;
+            float top = -std::numeric_limits<float>::infinity();
+            for (unsigned int i = 0; i < MAX_LEGAL_MOVES; ++i) {
+                if (indices[i] >= 0) top = std::max(top, logits[indices[i]]);
+            }
+            float sum = 0.0f;
+            for (unsigned int i = 0; i < MAX_LEGAL_MOVES; ++i) {
+                out[i] = indices[i] >= 0 ? std::exp(logits[indices[i]] - top) : 0.0f;
+                sum += out[i];
+            }
+            if (sum > 0.0f) {
+                for (unsigned int i = 0; i < MAX_LEGAL_MOVES; ++i) out[i] /= sum;
+            }
+        }
     }
 }
@@ -0,0 +1,101 @@
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <torch/version.h>
+#include "include/model/optimize.hpp"
+
+namespace {
+    // batch sizes run once after loading so the profiling executor has specialized the graph before the first search
+    constexpr unsigned int WARMUP_BATCHES[] = {1, 16, 64, 256};
+    constexpr int WARMUP_RUNS = 3;
+
+    // @return FNV-1a hash of a file's bytes, 0 if it cannot be read
+    uint64_t hashFile(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return 0;
+        uint64_t hash = 0xCBF29CE484222325ULL;
+        char buffer[1 << 16];
+        while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
+            for (std::streamsize i = 0; i < file.gcount(); ++i) {
+                hash = (hash ^ static_cast<unsigned char>(buffer[i])) * 0x100000001B3ULL;
+            }
+        }
+        return hash;
+    }
+
+    /*
+        @return Path of the cached frozen module for a model file and shape, empty if the file cannot be read
+        The libtorch version is part of the name, a frozen graph is only loadable by the version that froze it.
+    */
+    std::string cachePath(const std::string& model_path, const model::InferenceShape& shape) {
+        const uint64_t hash = hashFile(model_path);
+        if (hash == 0) return "";
+        std::ostringstream name;
+        name << std::hex << std::setw(16) << std::setfill('0') << hash << '-' << model::precisionName(shape.precision)
+             << '-' << shape.device.str() << (shape.packed ? "-packed" : "") << "-torch" << TORCH_VERSION << ".pt";
+        std::string file = name.str();
+        std::replace(file.begin(), file.end(), ':', '_');
+        return (std::filesystem::path(model_path).parent_path() / "frozen" / file).string();
+    }
+
+    void warmUp(torch::jit::script::Module& module, const model::InferenceShape& shape) {
+        for (const auto size : WARMUP_BATCHES) {
+            model::BatchBuffer batch(size, shape.input_planes, shape.policy_size, shape.device, shape.packed, model::scalarType(shape.precision));
+            const int legal[] = {0};
+            for (unsigned int i = 0; i < size; ++i) batch.setLegal(i, legal, 1);
+            batch.size = size;
+            for (int run = 0; run < WARMUP_RUNS; ++run) model::evaluate(batch, module, shape.device);
+        }
+    }
+}
+
+namespace model {
+
+    /*
+        Freezes a model for inference and warms it up. Freezing inlines the weights and buffers such as
+        the attention maps as constants, folds what depends only on them and fuses Linear layers. The
+        frozen module is cached in a frozen folder next to the model file, named by the file's hash, so
+        later startups load it instead of freezing again.
+        @return The frozen module, or module itself if it cannot be frozen
+        @param module: already converted to shape.precision on shape.device
+        @param model_path: file module was loaded from
+    */
+    torch::jit::script::Module optimizeForInference(torch::jit::script::Module& module, const std::string& model_path, const InferenceShape& shape) {
+        const std::string cached = cachePath(model_path, shape);
+        torch::jit::script::Module frozen;
+        bool ready = false;
+        // freezing needs eval mode, and an unfrozen fallback runs in it too
+        module.eval();
+        if (!cached.empty() && std::filesystem::exists(cached)) {
+            try {
+                frozen = torch::jit::load(cached, shape.device);
+                ready = true;
+                std::cout << "Loaded frozen model from " << cached << "\n";
+            } catch (const std::exception& e) {
+                std::cerr << "Ignoring unreadable frozen model " << cached << ": " << e.what() << std::endl;
+            }
+        }
+        if (!ready) {
+            try {
+                // not optimize_for_inference, the mkldnn constants it makes on the cpu cannot be saved
+                frozen = torch::jit::freeze(module);
+                ready = true;
+                if (!cached.empty()) {
+                    std::filesystem::create_directories(std::filesystem::path(cached).parent_path());
+                    frozen.save(cached);
+                    std::cout << "Saved frozen model to " << cached << "\n";
+                }
+            } catch (const std::exception& e) {
+                if (!ready) {
+                    std::cerr << "Could not freeze the model, running it unfrozen: " << e.what() << std::endl;
+                    frozen = module;
+                } else {
+                    std::cerr << "Could not cache the frozen model: " << e.what() << std::endl;
+                }
+            }
+        }
+        warmUp(frozen, shape);
+        return frozen;
+    }
+}
@@ -0,0 +1,121 @@
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <optional>
+#include "include/model/precision.hpp"
+#include "include/model/encoder.hpp"
+
+namespace {
+    // batches timed per precision in auto mode, after a few untimed ones
+    constexpr unsigned int BENCHMARK_BATCH = 64;
+    constexpr int WARMUP_RUNS = 2;
+    constexpr int TIMED_RUNS = 5;
+    constexpr unsigned int BENCHMARK_MOVES = 32;
+    // largest difference from fp32 in any prior or value a lower precision may show
+    constexpr float TOLERANCE = 0.02f;
+
+    struct Sample {
+        std::vector<EncodedState> positions;
+        std::vector<std::array<int, BENCHMARK_MOVES>> legal;
+    };
+
+    struct Trial {
+        double seconds = 0.0;
+        std::vector<float> priors;
+        std::vector<float> values;
+    };
+
+    // @return Random positions and move lists, the same sample is fed to every precision
+    Sample makeSample(const unsigned int input_planes, const unsigned int policy_size) {
+        std::mt19937_64 rng(0x5EED);
+        std::uniform_int_distribution<int> index(0, static_cast<int>(policy_size) - 1);
+        Sample sample;
+        sample.positions.resize(BENCHMARK_BATCH);
+        sample.legal.resize(BENCHMARK_BATCH);
+        for (unsigned int i = 0; i < BENCHMARK_BATCH; ++i) {
+            auto& position = sample.positions[i];
+            position.totalPlanes = static_cast<uint8_t>(input_planes);
+            // a quarter of the squares set, closer to real planes than half
+            for (unsigned int plane = 0; plane < input_planes; ++plane) position.encodedState[plane] = Bitboard(rng() & rng());
+            for (auto& move : sample.legal[i]) move = index(rng);
+        }
+        return sample;
+    }
+
+    // @return Time per batch and outputs of a model run in a precision, nothing if the device cannot run it
+    std::optional<Trial> runTrial(const torch::jit::script::Module& module, const torch::Device device, const model::Precision precision,
+                                  const Sample& sample, const unsigned int input_planes, const unsigned int policy_size, const bool packed) {
+        try {
+            auto candidate = module.deepcopy();
+            candidate.to(device, model::scalarType(precision));
+            candidate.eval();
+            model::BatchBuffer batch(BENCHMARK_BATCH, input_planes, policy_size, device, packed, model::scalarType(precision));
+            for (unsigned int i = 0; i < BENCHMARK_BATCH; ++i) {
+                sample.positions[i].write(batch, i);
+                batch.setLegal(i, sample.legal[i].data(), BENCHMARK_MOVES);
+            }
+            batch.size = BENCHMARK_BATCH;
+            for (int run = 0; run < WARMUP_RUNS; ++run) model::evaluate(batch, candidate, device);
+            const auto start = std::chrono::steady_clock::now();
+            for (int run = 0; run < TIMED_RUNS; ++run) model::evaluate(batch, candidate, device);
+            Trial trial;
+            trial.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / TIMED_RUNS;
+            for (unsigned int i = 0; i < BENCHMARK_BATCH; ++i) {
+                trial.priors.insert(trial.priors.end(), batch.priors(i), batch.priors(i) + BENCHMARK_MOVES);
+                trial.values.push_back(batch.value(i));
+            }
+            return trial;
+        } catch (const std::exception& e) {
+            std::cerr << model::precisionName(precision) << " is not supported on this device: " << e.what() << std::endl;
+            return std::nullopt;
+        }
+    }
+
+    // @return Largest difference between the outputs of two trials
+    float deviation(const Trial& trial, const Trial& reference) {
+        float largest = 0.0f;
+        for (size_t i = 0; i < trial.priors.size(); ++i) largest = std::max(largest, std::abs(trial.priors[i] - reference.priors[i]));
+        for (size_t i = 0; i < trial.values.size(); ++i) largest = std::max(largest, std::abs(trial.values[i] - reference.values[i]));
+        // NaN outputs never pass
+        return largest == largest ? largest : std::numeric_limits<float>::infinity();
+    }
+}
+
+namespace model {
+
+    /*
+        Picks the precision a model runs in. In auto mode each precision is timed on a few batches
+        on the device itself, and the fastest one whose outputs stay within TOLERANCE of fp32 wins.
+        INT8 trades strength for speed and is never picked automatically.
+        @return The precision to convert the model to, INT8 when the quantized model should be loaded
+        @param mode: fp32, bf16, fp16, int8 or auto, from params.txt
+        @param input_planes: planes of one position, input_planes and packed match the searches' input
+    */
+    Precision selectPrecision(const torch::jit::script::Module& module, const torch::Device device, const std::string& mode,
+                              const unsigned int input_planes, const unsigned int policy_size, const bool packed) {
+        if (mode == "fp32" || mode == "bf16" || mode == "fp16") return precisionFromName(mode);
+        // quantized kernels only exist for the cpu
+        if (mode == "int8" && device.is_cpu()) return Precision::INT8;
+        if (mode == "int8") std::cerr << "int8 inference needs the cpu, using auto" << std::endl;
+        else if (mode != "auto") std::cerr << "Unknown inference_precision " << mode << ", using auto" << std::endl;
+
+        const auto sample = makeSample(input_planes, policy_size);
+        const auto reference = runTrial(module, device, Precision::FP32, sample, input_planes, policy_size, packed);
+        if (!reference) return Precision::FP32;
+        std::cout << "fp32: " << reference->seconds * 1000.0 << " ms per batch\n";
+
+        Precision best = Precision::FP32;
+        double best_seconds = reference->seconds;
+        for (const auto precision : {Precision::BF16, Precision::FP16}) {
+            const auto trial = runTrial(module, device, precision, sample, input_planes, policy_size, packed);
+            if (!trial) continue;
+            const float error = deviation(*trial, *reference);
+            std::cout << precisionName(precision) << ": " << trial->seconds * 1000.0 << " ms per batch, deviation " << error << "\n";
+            if (error <= TOLERANCE && trial->seconds < best_seconds) {
+                best = precision;
+                best_seconds = trial->seconds;
+            }
+        }
+        return best;
+    }
+}
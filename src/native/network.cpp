@@ -0,0 +1,270 @@
+#include <fstream>
+#include <stdexcept>
+#include "include/native/network.hpp"
+
+namespace {
+    // "NNET" read as a little endian word, and the layout version model/export.py writes
+    constexpr uint32_t MAGIC = 0x54454E4E;
+    constexpr uint32_t VERSION = 1;
+    // positions run through the network together, enough rows to reuse each weight block, few enough to stay in cache
+    constexpr int CHUNK_POSITIONS = 8;
+
+    // Reads the tensors of a weight file in order, each is a float count followed by its floats.
+    class Reader {
+    public:
+        explicit Reader(const std::string& path) : file(path, std::ios::binary) {
+            if (!file) throw std::runtime_error("cannot open native weights " + path);
+        }
+
+        uint32_t word() {
+            uint32_t value = 0;
+            if (!file.read(reinterpret_cast<char*>(&value), sizeof(value))) throw std::runtime_error("native weights end early");
+            return value;
+        }
+
+        std::vector<float> tensor(const size_t count) {
+            const uint32_t stored = word();
+            if (stored != count) {
+                throw std::runtime_error("native weights hold " + std::to_string(stored) + " values where " + std::to_string(count) + " were expected");
+            }
+            std::vector<float> values(count);
+            if (!file.read(reinterpret_cast<char*>(values.data()), static_cast<std::streamsize>(count * sizeof(float)))) {
+                throw std::runtime_error("native weights end early");
+            }
+            return values;
+        }
+
+        // torch stores a Linear weight out x in, it is kept transposed
+        native::Linear linear(const uint32_t in, const uint32_t out, const bool bias = true) {
+            native::Linear layer;
+            layer.in = static_cast<int>(in);
+            layer.out = static_cast<int>(out);
+            const auto weight = tensor(static_cast<size_t>(in) * out);
+            layer.weight.resize(weight.size());
+            native::kernels::transpose(weight.data(), in, layer.weight.data(), out, static_cast<int>(out), static_cast<int>(in));
+            if (bias) layer.bias = tensor(out);
+            return layer;
+        }
+
+        native::LayerNorm norm(const uint32_t size) {
+            native::LayerNorm layer;
+            layer.gamma = tensor(size);
+            layer.beta = tensor(size);
+            return layer;
+        }
+
+        native::PositionalEncoding encoding(const native::Config& shape, const uint32_t input_dim) {
+            const uint32_t dim = shape.positional_encoding_dim;
+            native::PositionalEncoding encoding;
+            encoding.p_enc = linear(input_dim, dim);
+            encoding.norm1 = norm(dim);
+            encoding.linear = linear(dim, shape.attention_heads * dim);
+            encoding.norm2 = norm(dim);
+            encoding.p_dec = linear(dim, shape.seq_len);
+            return encoding;
+        }
+
+    private:
+        std::ifstream file;
+    };
+
+    template<typename T>
+    void grow(std::vector<T>& buffer, const size_t size) {
+        if (buffer.size() < size) buffer.resize(size);
+    }
+}
+
+namespace native {
+
+    /*
+        Loads a weight file written by model/export.py --native
+        @throws std::runtime_error if the file cannot be read or does not match its header
+    */
+    Network::Network(const std::string& path) {
+        Reader reader(path);
+        if (reader.word() != MAGIC) throw std::runtime_error(path + " is not a native weight file");
+        if (reader.word() != VERSION) throw std::runtime_error(path + " has an unsupported native weight version");
+        for (uint32_t* field : {&shape.input_dim, &shape.seq_len, &shape.position_embedding_dim, &shape.embedding_dim, &shape.hidden_layers,
+                                &shape.attention_dim, &shape.attention_heads, &shape.positional_encoding_dim, &shape.dim_feedforward,
+                                &shape.value_model_dim, &shape.policy_model_dim, &shape.policy_out_dim}) {
+            *field = reader.word();
+        }
+        if (shape.seq_len != 64) throw std::runtime_error("native network needs 64 squares");
+        if (shape.attention_heads == 0 || shape.attention_dim % shape.attention_heads || shape.policy_model_dim % shape.attention_heads) {
+            throw std::runtime_error("native network head sizes do not divide");
+        }
+
+        const uint32_t input = shape.input_dim;
+        const uint32_t width = shape.embedding_dim;
+        embedding = reader.linear(input, shape.position_embedding_dim);
+        embedding_norm1 = reader.norm(input + shape.position_embedding_dim);
+        embedding_linear1 = reader.linear(input + shape.position_embedding_dim, width, false);
+        map_bias = reader.tensor(static_cast<size_t>(shape.seq_len) * width);
+        embedding_norm2 = reader.norm(width);
+
+        blocks.resize(shape.hidden_layers);
+        for (auto& block : blocks) {
+            block.qkv = reader.linear(width, 3 * shape.attention_dim);
+            block.p_enc = reader.encoding(shape, width);
+            block.out = reader.linear(shape.attention_dim, width);
+            block.norm1 = reader.norm(width);
+            block.feedforward1 = reader.linear(width, shape.dim_feedforward);
+            block.feedforward2 = reader.linear(shape.dim_feedforward, width);
+            block.norm2 = reader.norm(width);
+        }
+
+        value_linear1 = reader.linear(width, shape.value_model_dim);
+        value_linear2 = reader.linear(shape.seq_len * shape.value_model_dim, shape.seq_len);
+        value_linear3 = reader.linear(shape.seq_len, 1);
+
+        policy_query = reader.tensor(static_cast<size_t>(shape.seq_len) * shape.policy_model_dim);
+        policy_kv = reader.linear(width, 2 * shape.policy_model_dim);
+        policy_p_enc = reader.encoding(shape, width);
+        policy_out = reader.linear(shape.policy_model_dim, width);
+        policy_norm = reader.norm(width);
+        policy_linear = reader.linear(width, shape.policy_out_dim);
+    }
+
+    /*
+        Runs the network on a batch of positions
+        @param input: batch * planes() * 64 values, the layout of a dense batch input
+        @param policy: batch * policySize() logits written
+        @param value: batch values written
+    */
+    void Network::forward(const float* input, const int batch, float* policy, float* value, Workspace& workspace) const {
+        const size_t input_size = static_cast<size_t>(planes()) * 64;
+        for (int start = 0; start < batch; start += CHUNK_POSITIONS) {
+            const int positions = std::min(CHUNK_POSITIONS, batch - start);
+            forwardChunk(input + start * input_size, positions, policy + static_cast<size_t>(start) * policySize(), value + start, workspace);
+        }
+    }
+
+    // Writes the attention biases of every square and head of rows squares into workspace.biases.
+    void Network::encode(const PositionalEncoding& encoding, const float* x, const int rows, Workspace& workspace) const {
+        const int dim = static_cast<int>(shape.positional_encoding_dim);
+        const int heads = static_cast<int>(shape.attention_heads);
+        encoding.p_enc.apply(x, shape.embedding_dim, rows, workspace.encoding.data(), dim);
+        encoding.norm1.apply(workspace.encoding.data(), dim, rows);
+        encoding.linear.apply(workspace.encoding.data(), dim, rows, workspace.encoded.data(), heads * dim);
+        // each head's slice of a square is normalized and decoded on its own, the slices are consecutive rows
+        encoding.norm2.apply(workspace.encoded.data(), dim, rows * heads);
+        encoding.p_dec.apply(workspace.encoded.data(), dim, rows * heads, workspace.biases.data(), shape.seq_len);
+    }
+
+    /*
+        Attention of every head of every position, softmax(q k^T + bias) v, queries carry the 1 / sqrt(dk) scale
+        @param query_position_stride: 0 when every position shares the queries
+        @param keys: keys of the first head of the first position, values are value_offset after the keys of a head
+    */
+    void Network::attend(const float* queries, const size_t ldq, const size_t query_position_stride, const size_t query_head_stride,
+                         const float* keys, const size_t ldkv, const size_t kv_head_stride, const size_t value_offset,
+                         const int positions, const int head_dim, float* out, const size_t ldo, Workspace& workspace) const {
+        const int squares = static_cast<int>(shape.seq_len);
+        const int heads = static_cast<int>(shape.attention_heads);
+        for (int position = 0; position < positions; ++position) {
+            for (int head = 0; head < heads; ++head) {
+                const float* q = queries + position * query_position_stride + head * query_head_stride;
+                const float* k = keys + static_cast<size_t>(position) * squares * ldkv + head * kv_head_stride;
+                const float* bias = workspace.biases.data() + (static_cast<size_t>(position) * squares * heads + head) * squares;
+                kernels::transpose(k, ldkv, workspace.keys.data(), squares, squares, head_dim);
+                kernels::gemm(q, ldq, workspace.keys.data(), squares, workspace.scores.data(), squares, squares, squares, head_dim, nullptr);
+                for (int i = 0; i < squares; ++i) {
+                    float* row = workspace.scores.data() + i * squares;
+                    const float* bias_row = bias + static_cast<size_t>(i) * heads * squares;
+                    for (int j = 0; j < squares; ++j) row[j] += bias_row[j];
+                }
+                kernels::softmax(workspace.scores.data(), squares, squares, squares);
+                kernels::gemm(workspace.scores.data(), squares, k + value_offset, ldkv,
+                              out + static_cast<size_t>(position) * squares * ldo + head * head_dim, ldo, squares, head_dim, squares, nullptr);
+            }
+        }
+    }
+
+    void Network::forwardChunk(const float* input, const int positions, float* policy, float* value, Workspace& workspace) const {
+        const int squares = static_cast<int>(shape.seq_len);
+        const int rows = positions * squares;
+        const int input_dim = static_cast<int>(shape.input_dim);
+        const int width = static_cast<int>(shape.embedding_dim);
+        const int heads = static_cast<int>(shape.attention_heads);
+        const int attention_dim = static_cast<int>(shape.attention_dim);
+        const int policy_dim = static_cast<int>(shape.policy_model_dim);
+        const int concat = input_dim + static_cast<int>(shape.position_embedding_dim);
+        const int value_dim = static_cast<int>(shape.value_model_dim);
+
+        grow(workspace.x, static_cast<size_t>(rows) * width);
+        grow(workspace.residual, static_cast<size_t>(rows) * width);
+        grow(workspace.wide, static_cast<size_t>(rows) * std::max({concat, static_cast<int>(shape.dim_feedforward), value_dim}));
+        grow(workspace.projected, static_cast<size_t>(rows) * std::max(3 * attention_dim, 2 * policy_dim));
+        grow(workspace.attention, static_cast<size_t>(rows) * std::max(attention_dim, policy_dim));
+        grow(workspace.encoding, static_cast<size_t>(rows) * shape.positional_encoding_dim);
+        grow(workspace.encoded, static_cast<size_t>(rows) * heads * shape.positional_encoding_dim);
+        grow(workspace.biases, static_cast<size_t>(rows) * heads * squares);
+        grow(workspace.keys, static_cast<size_t>(squares) * std::max(attention_dim, policy_dim));
+        grow(workspace.scores, static_cast<size_t>(squares) * squares);
+        grow(workspace.head, static_cast<size_t>(positions) * squares);
+
+        // input embedding, a square's input_dim values are consecutive in the input
+        float* joined = workspace.wide.data();
+        for (int row = 0; row < rows; ++row) std::copy(input + row * input_dim, input + (row + 1) * input_dim, joined + row * concat);
+        embedding.apply(input, input_dim, rows, joined + input_dim, concat);
+        embedding_norm1.apply(joined, concat, rows);
+        kernels::relu(joined, static_cast<size_t>(rows) * concat);
+        embedding_linear1.apply(joined, concat, rows, workspace.x.data(), width);
+        for (int row = 0; row < rows; ++row) {
+            float* out = workspace.x.data() + static_cast<size_t>(row) * width;
+            const float* bias = map_bias.data() + static_cast<size_t>(row % squares) * width;
+            for (int i = 0; i < width; ++i) out[i] += bias[i];
+        }
+        embedding_norm2.apply(workspace.x.data(), width, rows);
+        kernels::relu(workspace.x.data(), static_cast<size_t>(rows) * width);
+
+        auto addResidual = [&workspace, rows, width] {
+            float* out = workspace.residual.data();
+            const float* x = workspace.x.data();
+            for (size_t i = 0; i < static_cast<size_t>(rows) * width; ++i) out[i] += x[i];
+        };
+
+        const int head_dim = attention_dim / heads;
+        for (const auto& block : blocks) {
+            block.qkv.apply(workspace.x.data(), width, rows, workspace.projected.data(), 3 * attention_dim);
+            encode(block.p_enc, workspace.x.data(), rows, workspace);
+            // each head's slice of qkv is [q, k, v]
+            attend(workspace.projected.data(), 3 * attention_dim, static_cast<size_t>(squares) * 3 * attention_dim, 3 * head_dim,
+                   workspace.projected.data() + head_dim, 3 * attention_dim, 3 * head_dim, head_dim,
+                   positions, head_dim, workspace.attention.data(), attention_dim, workspace);
+            block.out.apply(workspace.attention.data(), attention_dim, rows, workspace.residual.data(), width);
+            addResidual();
+            block.norm1.apply(workspace.residual.data(), width, rows);
+            std::swap(workspace.x, workspace.residual);
+
+            block.feedforward1.apply(workspace.x.data(), width, rows, workspace.wide.data(), shape.dim_feedforward);
+            kernels::relu(workspace.wide.data(), static_cast<size_t>(rows) * shape.dim_feedforward);
+            block.feedforward2.apply(workspace.wide.data(), shape.dim_feedforward, rows, workspace.residual.data(), width);
+            addResidual();
+            block.norm2.apply(workspace.residual.data(), width, rows);
+            std::swap(workspace.x, workspace.residual);
+        }
+
+        // value head, the squares of a position are flattened into one row
+        value_linear1.apply(workspace.x.data(), width, rows, workspace.wide.data(), value_dim);
+        kernels::relu(workspace.wide.data(), static_cast<size_t>(rows) * value_dim);
+        value_linear2.apply(workspace.wide.data(), static_cast<size_t>(squares) * value_dim, positions, workspace.head.data(), squares);
+        kernels::relu(workspace.head.data(), static_cast<size_t>(positions) * squares);
+        value_linear3.apply(workspace.head.data(), squares, positions, value, 1);
+        for (int i = 0; i < positions; ++i) value[i] = std::tanh(value[i]);
+
+        // policy head, its queries are shared by every position
+        const int policy_head_dim = policy_dim / heads;
+        policy_kv.apply(workspace.x.data(), width, rows, workspace.projected.data(), 2 * policy_dim);
+        encode(policy_p_enc, workspace.x.data(), rows, workspace);
+        attend(policy_query.data(), policy_head_dim, 0, static_cast<size_t>(squares) * policy_head_dim,
+               workspace.projected.data(), 2 * policy_dim, 2 * policy_head_dim, policy_head_dim,
+               positions, policy_head_dim, workspace.attention.data(), policy_dim, workspace);
+        policy_out.apply(workspace.attention.data(), policy_dim, rows, workspace.residual.data(), width);
+        addResidual();
+        policy_norm.apply(workspace.residual.data(), width, rows);
+        kernels::relu(workspace.residual.data(), static_cast<size_t>(rows) * width);
+        // a position's logits are square major, square * policy_out_dim + plane
+        policy_linear.apply(workspace.residual.data(), width, rows, policy, shape.policy_out_dim);
+    }
+}
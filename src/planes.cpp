@@ -1,20 +1,23 @@
 #include "include/planes.hpp"
 
-// creates a set of board representation planes for a position
-std::unique_ptr<Bitboard[]> planes::toPlane(const Board& board, Color color) {
-    auto plane = std::make_unique<Bitboard[]>(14);
+/*
+    Writes the board representation planes of a position
+    @param repetitions: earlier occurrences of the position, from Board::repetitionCount
+    @param plane: POSITION_PLANES bitboards to write
+*/
+void planes::toPlane(const Board& board, Color color, int repetitions, Bitboard* plane) {
     const Board& position = board;
     Bitboard repetition1;
     Bitboard repetition2;
-    if (position.isRepetition(1)) {
+    if (repetitions >= 1) {
         repetition1 = ~repetition1;
-        if (position.isRepetition(2)) {
+        if (repetitions >= 2) {
             repetition2 = ~repetition2;
         }
     }
     int index = 0;
     bool reverseRanks = (color == Color::BLACK);
-    auto addPieces = [&plane, &position, color, &index, reverseRanks](Color pieceColor) {
+    auto addPieces = [plane, &position, color, &index, reverseRanks](Color pieceColor) {
         std::array<PieceType, 6> pieceTypes = {PieceType::PAWN, PieceType::KNIGHT, PieceType::BISHOP, PieceType::ROOK, PieceType::QUEEN, PieceType::KING};
         for (const auto& pieceType : pieceTypes) {
             Bitboard pieces = position.pieces(pieceType, pieceColor);
@@ -27,12 +30,10 @@ std::unique_ptr<Bitboard[]> planes::toPlane(const Board& board, Color color) {
     addPieces(~color);
     plane[12] = repetition1;
     plane[13] = repetition2;
-    return plane;
 }
 
-// creates planes with additional positional information
-std::unique_ptr<Bitboard[]> planes::extraPlanes(const Board& board) {
-    auto plane = std::make_unique<Bitboard[]>(6);
+// writes EXTRA_PLANES planes with additional positional information
+void planes::extraPlanes(const Board& board, Bitboard* plane) {
     const Board& position = board;
     Color color = position.sideToMove();
     Bitboard colorBoard;
@@ -78,14 +79,11 @@ std::unique_ptr<Bitboard[]> planes::extraPlanes(const Board& board) {
     // plane[5] = p1A;
     // plane[6] = p2A;
     plane[5] = enPassant;
-
-    return plane;
 }
 
-std::unique_ptr<Bitboard[]> planes::emptyPlane() {
-    auto plane = std::make_unique<Bitboard[]>(14);
-    for (int i = 0; i < 14; ++i) {
+// writes POSITION_PLANES empty planes for history before the start of the game
+void planes::emptyPlane(Bitboard* plane) {
+    for (int i = 0; i < POSITION_PLANES; ++i) {
         plane[i] = Bitboard(0);
     }
-    return plane;
 }
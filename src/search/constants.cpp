@@ -12,4 +12,16 @@ float cpuct_factor = 0.0;
 int checks_before_move = 0;
 int growth_before_check = 0;
 int thread_count = 0;
+int search_threads = 0;
 int transposition_table_size = 0;
+std::string batching_profile = "";
+int packed_input = 0;
+int inference_executors = 1;
+int intra_op_threads = 0;
+int pin_executor_threads = 0;
+std::string inference_precision = "";
+std::string inference_backend = "";
+int mock_batch_latency_us = 1000;
+int mock_position_latency_us = 0;
+int nn_batch_size = 256;
+std::string tuning_profile = "";
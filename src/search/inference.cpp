@@ -0,0 +1,218 @@
+#include "include/search/inference.hpp"
+#include "include/search/play_policy_map.hpp"
+
+InferenceStage::InferenceStage(model::ExecutorPool& executors, unsigned int batch_size, unsigned int input_planes, unsigned int policy_size,
+                               bool packed_input, unsigned int dispatch_threads, Dispatch dispatch,
+                               const BatchingProfile& profile, std::chrono::microseconds latency)
+    : executors(executors),
+      batch_size(std::max(profile.max_batch_size ? std::min(batch_size, profile.max_batch_size) : batch_size, 1u)),
+      dispatch(std::move(dispatch)), profile(profile), latency_us(latency.count()),
+      dispatch_pool(std::make_unique<ThreadPool>(std::max(dispatch_threads, 1u))) {
+    for (unsigned int i = 0; i <= std::max(executors.size(), 1u); ++i) {
+        auto batch = std::make_unique<Batch>();
+        batch->buffer = model::BatchBuffer(this->batch_size, input_planes, policy_size, executors.getDevice(), packed_input, executors.inputType());
+        batch->requests.reserve(this->batch_size);
+        batches.push_back(std::move(batch));
+    }
+    worker = std::thread(&InferenceStage::run, this);
+}
+
+InferenceStage::~InferenceStage() {
+    stop();
+}
+
+// Queues an encoded leaf for evaluation, never blocks the calling search thread.
+void InferenceStage::submit(EncodedState state, const EvalRequest& request) {
+    queue.push(Item{std::move(state), request, Clock::now()});
+    wake();
+}
+
+// Asks for the batch being filled to be evaluated without waiting for it to fill up.
+void InferenceStage::flush() {
+    flush_requested.store(true, std::memory_order_release);
+    wake();
+}
+
+/*
+    Evaluates everything submitted so far and waits for its results to be written back, the threads
+    keep running for the next search. Submitting threads must be done before it is called.
+*/
+void InferenceStage::finish() {
+    const uint64_t ticket = finish_requested.fetch_add(1) + 1;
+    wake();
+    std::unique_lock<std::mutex> guard(completed_lock);
+    completed_cv.wait(guard, [this, ticket] { return finish_answered.load(std::memory_order_acquire) >= ticket; });
+}
+
+// Evaluates everything submitted so far, waits for its results to be written back and joins the threads.
+void InferenceStage::stop() {
+    if (!worker.joinable()) return;
+    stopping.store(true, std::memory_order_release);
+    wake();
+    worker.join();
+    dispatch_pool.reset();
+}
+
+// Bumps the signal and wakes the inference thread if it is sleeping, the lock is only taken when it is.
+void InferenceStage::wake() {
+    // sequentially consistent with sleep(): either the sleeper sees the new signal or this sees it sleeping
+    signal.fetch_add(1);
+    if (sleeping.load()) {
+        std::lock_guard<std::mutex> guard(wake_lock);
+        wake_cv.notify_one();
+    }
+}
+
+/*
+    Sleeps the inference thread until the signal moves past seen or until passes
+    @param seen: signal read before the queue was found empty
+    @param until: deadline of the batch being filled, time_point::max() when it is empty
+*/
+void InferenceStage::sleep(const uint64_t seen, const Clock::time_point until) {
+    std::unique_lock<std::mutex> guard(wake_lock);
+    sleeping.store(true);
+    auto changed = [this, seen] { return signal.load() != seen; };
+    if (until == Clock::time_point::max()) wake_cv.wait(guard, changed);
+    else wake_cv.wait_until(guard, until, changed);
+    sleeping.store(false);
+}
+
+// @return How long the oldest leaf of a partial batch may wait, a fraction of the measured model latency
+std::chrono::microseconds InferenceStage::deadline() const {
+    const int64_t measured = latency_us.load(std::memory_order_relaxed);
+    if (measured <= 0) return profile.max_deadline;
+    const auto scaled = std::chrono::microseconds(static_cast<int64_t>(profile.latency_fraction * static_cast<float>(measured)));
+    return std::clamp(scaled, profile.min_deadline, profile.max_deadline);
+}
+
+/*
+    Blocks until a batch after seen has been evaluated, or briefly if none is pending
+    @param seen: value of completedBatches() when the caller ran into a pending evaluation
+*/
+void InferenceStage::waitForBatch(const uint64_t seen) {
+    std::unique_lock<std::mutex> guard(completed_lock);
+    completed_cv.wait_for(guard, std::chrono::milliseconds(1), [this, seen] { return completedBatches() != seen; });
+}
+
+void InferenceStage::run() {
+    size_t current = 0;
+    while (true) {
+        Batch& batch = *batches[current];
+        // the buffer's previous batch may still be evaluating or dispatching
+        drain(batch);
+        batch.requests.clear();
+        if (collect(batch)) {
+            evaluate(batch);
+            current = (current + 1) % batches.size();
+            continue;
+        }
+        // results still in flight are dispatched before finish() returns or stop() tears the dispatch pool down
+        for (auto& pending : batches) drain(*pending);
+        if (stopping.load(std::memory_order_acquire)) break;
+        {
+            std::lock_guard<std::mutex> guard(completed_lock);
+            finish_answered.store(finishing, std::memory_order_release);
+        }
+        completed_cv.notify_all();
+    }
+}
+
+// Blocks until every result of a batch buffer has been written back and its executor is done with it.
+void InferenceStage::drain(Batch& batch) {
+    {
+        std::unique_lock<std::mutex> guard(completed_lock);
+        completed_cv.wait(guard, [&batch] { return !batch.evaluating; });
+    }
+    for (uint32_t left = batch.outstanding.load(std::memory_order_acquire); left != 0; left = batch.outstanding.load(std::memory_order_acquire)) {
+        batch.outstanding.wait(left, std::memory_order_acquire);
+    }
+}
+
+/*
+    Fills a batch from the queue until it is full, its oldest leaf is past the deadline, a flush is
+    requested or the stage is finishing or stopping
+    @return false once the stage is finishing or stopping and nothing is left to evaluate
+*/
+bool InferenceStage::collect(Batch& batch) {
+    Clock::time_point due = Clock::time_point::max();
+    while (batch.requests.size() < batch_size) {
+        // read before popping so a submit racing with the empty check still wakes the sleep below
+        const uint64_t seen = signal.load();
+        // read before popping too, everything submitted before a finish call is then in the queue
+        const uint64_t requested = finish_requested.load();
+        Item item;
+        if (queue.pop(item)) {
+            // the queue is FIFO, the first leaf of the batch is its oldest
+            if (batch.requests.empty()) due = item.submitted + deadline();
+            add(batch, item);
+            continue;
+        }
+        if (!batch.requests.empty()) {
+            if (flush_requested.exchange(false, std::memory_order_acq_rel)) break;
+            if (Clock::now() >= due) break;
+        }
+        // search threads are joined before finish and stop, so an empty queue is really empty here
+        if (requested != finish_answered.load(std::memory_order_relaxed)) {
+            finishing = requested;
+            break;
+        }
+        if (stopping.load(std::memory_order_acquire)) break;
+        sleep(seen, due);
+    }
+    return !batch.requests.empty();
+}
+
+// Writes a leaf's input planes and legal move list into the next slot of a batch.
+void InferenceStage::add(Batch& batch, const Item& item) {
+    const auto slot = static_cast<unsigned int>(batch.requests.size());
+    item.state.write(batch.buffer, slot);
+    // the leaf's edges were created before it was submitted
+    const Node* node = item.request.node;
+    int indices[model::MAX_LEGAL_MOVES];
+    for (uint16_t i = 0; i < node->num_moves; ++i) {
+        indices[i] = policy_map::move_to_index(node->edges[i].move, item.request.side);
+    }
+    batch.buffer.setLegal(slot, indices, node->num_moves);
+    batch.requests.push_back(item.request);
+}
+
+// Hands a batch to the next free executor, the inference thread goes on to fill the next buffer.
+void InferenceStage::evaluate(Batch& batch) {
+    const auto start = Clock::now();
+    batch.buffer.size = static_cast<unsigned int>(batch.requests.size());
+    // counts the batch as in flight until its last result is written back
+    batch.outstanding.store(static_cast<uint32_t>(batch.requests.size()), std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> guard(completed_lock);
+        batch.evaluating = true;
+    }
+    executors.submit(batch.buffer, [this, &batch, start] { finished(batch, start); });
+}
+
+// Runs on the executor once a batch is evaluated and hands one dispatch task per result to the pool.
+void InferenceStage::finished(Batch& batch, const Clock::time_point start) {
+    // exponential average over recent batches, includes time spent waiting for a free executor
+    const int64_t sample = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+    const int64_t previous = latency_us.load(std::memory_order_relaxed);
+    latency_us.store(previous <= 0 ? sample : (7 * previous + sample) / 8, std::memory_order_relaxed);
+    for (unsigned int i = 0; i < batch.buffer.size; ++i) {
+        // the buffer is not refilled until every dispatch of it is done, so tasks read it in place
+        dispatch_pool->enqueueTask([this, &batch, i] {
+            dispatch(batch.buffer.priors(i), batch.buffer.value(i), batch.requests[i]);
+            if (batch.outstanding.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                batch.outstanding.notify_one();
+                {
+                    std::lock_guard<std::mutex> guard(completed_lock);
+                    completed.fetch_add(1, std::memory_order_release);
+                }
+                completed_cv.notify_all();
+            }
+        });
+    }
+    // notified under the lock, the stage may be torn down as soon as it is released
+    std::lock_guard<std::mutex> guard(completed_lock);
+    stats.positions += batch.buffer.size;
+    stats.batch_latencies.emplace_back(sample);
+    batch.evaluating = false;
+    completed_cv.notify_all();
+}
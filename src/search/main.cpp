@@ -3,8 +3,13 @@
 #include "include/search/search.hpp"
 #include "include/selfplay/selfplay.hpp"
 #include "include/config.hpp"
+#include "include/model/optimize.hpp"
+#include "include/model/evaluator.hpp"
+#include "include/search/tuner.hpp"
 #include "include/utils/functions.hpp"
+#include "include/utils/bit_unpack.hpp"
 #include <chrono>
+#include <cmath>
 #include <torch/script.h>
 #include <torch/torch.h>
 #include <fstream>
@@ -86,7 +91,7 @@ std::array<std::string, 8> test_positions =
                 "r1bq1b1r/1p3ppp/p4N2/1B1PpkB1/2Q5/8/PPP2PPP/R3K2R w KQ - 2 13",
                 "3r1bk1/1b2qp1p/2p1p1p1/1pP1P2P/1Pp1B2Q/2B3P1/5PK1/2R5 w - - 3 30"};
 
-void selfPlay(torch::jit::script::Module& nnet, torch::Device device) {
+void selfPlay(const model::Evaluator& evaluator) {
 
     unsigned int total_games, num_simulations, nn_cache_size;
 
@@ -96,24 +101,25 @@ void selfPlay(torch::jit::script::Module& nnet, torch::Device device) {
     std::cout << "Enter the number of simulations (higher gives more accuracy but longer training time): ";
     std::cin >> num_simulations;
 
-    std::cout << "Enter the eval cache size (higher values will give more breadth but less depth to search and potentially faster training): ";
+    std::cout << "Enter the eval cache size (higher values will give more breadth but less depth to search and potentially faster training, 0 for nn_batch_size=" << nn_batch_size << "): ";
     std::cin >> nn_cache_size;
+    if (nn_cache_size == 0) nn_cache_size = static_cast<unsigned int>(nn_batch_size);
 
     clearTerminal();
 
     std::cout << "Total games: " << total_games << std::endl;
     std::cout << "Number of simulations: " << num_simulations << std::endl;
     std::cout << "Eval cache size: " << nn_cache_size << std::endl;
-    std::cout << "Number of threads: " << thread_count << std::endl;
+    std::cout << "Concurrent games: " << thread_count << std::endl;
     std::cout << "Win threshold: " << resign_eval_threshold << std::endl;
     std::cout << "Starting temperature: " << temperature_start << std::endl;
 
-    auto self_play = SelfPlay(total_games, num_simulations, thread_count, resign_eval_threshold, nn_cache_size, true, nnet, device, transposition_table_size, temperature_start);
+    auto self_play = SelfPlay(total_games, num_simulations, thread_count, resign_eval_threshold, nn_cache_size, true, evaluator, transposition_table_size, temperature_start);
     std::cout << "transposition table size: " << self_play.transposition_table.max_elements << " positions\n";
     self_play.run();
 }
 
-void testPosition(torch::jit::script::Module& nnet, torch::Device device) {
+void testPosition(const model::Evaluator& evaluator) {
 
     unsigned int time_per_move;
 
@@ -141,15 +147,15 @@ void testPosition(torch::jit::script::Module& nnet, torch::Device device) {
     }
     clearTerminal();
 
-    TranspositionTable<uint64_t, std::pair<std::unordered_map<chess::Move, float>, float>> transposition_table;
+    EvalTable transposition_table;
     transposition_table.set_size(transposition_table_size);
     std::vector<chess::Board> traversed = {};
-    unsigned int num_simulations = 100000, nn_cache_size = 256;
+    unsigned int num_simulations = 100000, nn_cache_size = static_cast<unsigned int>(nn_batch_size);
 
     std::cout << startState << "\n";
     Container container;
-    auto rootNode = new Node(container, startState, 0);
-    auto newSearch = Search(rootNode, container, traversed, transposition_table, nnet, device, num_simulations, thread_count, nn_cache_size, true);
+    auto rootNode = container.create(0);
+    auto newSearch = Search(rootNode, startState, container, traversed, transposition_table, evaluator, num_simulations, search_threads, nn_cache_size, true);
     newSearch.startSearch(true, true, std::chrono::seconds(time_per_move));
 
     auto white_win_prob = newSearch.getRootQ()*(1-2*static_cast<int>(startState.sideToMove()));
@@ -159,7 +165,78 @@ void testPosition(torch::jit::script::Module& nnet, torch::Device device) {
     std::cout << "Engine Top Line:\n" << topLine << ", Evaluation = " << probability_to_centipawn(white_win_prob) << '\n';
 }
 
-void humanGame(torch::jit::script::Module& nnet, torch::Device device) {
+/*
+    Sweeps batch size, search threads and inference executors on this host and model, then saves
+    the fastest combination as the tuning profile later runs load
+*/
+void tune(const model::Evaluator& evaluator) {
+
+    unsigned int num_simulations;
+
+    std::cout << "Enter the number of simulations per position (each combination searches " << test_positions.size() << " positions): ";
+    std::cin >> num_simulations;
+
+    clearTerminal();
+
+    Tuner tuner(evaluator, std::vector<std::string>(test_positions.begin(), test_positions.end()), num_simulations);
+    const auto results = tuner.run(TuningGrid::forHost());
+    const auto& best = results.front();
+    std::cout << "\nFastest: nn_batch_size=" << best.batch_size << ", search_threads=" << best.search_threads
+              << ", inference_executors=" << best.inference_executors << ", " << static_cast<int>(best.simulations_per_second) << " simulations/s\n";
+    tuner.apply(best);
+    // with no profile configured it is saved for the user to opt into, params.txt stays in charge until then
+    const std::string path = tuning_profile.empty() ? "tuned_profile.txt" : tuning_profile;
+    if (!tuner.save(best, path)) std::cerr << "Failed to write " << path << std::endl;
+    else if (tuning_profile.empty()) std::cout << "Saved to " << path << ", set tuning_profile=" << path << " in params.txt to load it over params.txt\n";
+    else std::cout << "Saved to " << path << ", later runs load it over params.txt\n";
+}
+
+/*
+    Searches positions with one clearly best move using the mock evaluator, so the search is checked
+    without a model. Every search has to end with exactly its simulation budget of root visits and
+    with the expected move as the most visited one, with one search thread and with several.
+    @return true if every search passed
+*/
+bool checkSearch() {
+    // a rook taking a hanging queen, for either side to move
+    const std::vector<std::pair<std::string, std::string>> cases = {
+        {"4k3/8/8/3q4/8/8/8/3RK3 w - - 0 1", "d1d5"},
+        {"3rk3/8/8/8/3Q4/8/8/4K3 b - - 0 1", "d8d4"},
+    };
+    constexpr unsigned int num_simulations = 800;
+    const model::MockEvaluator evaluator(std::chrono::microseconds(0), std::chrono::microseconds(0));
+
+    bool passed = true;
+    for (const unsigned int threads : {1u, 4u}) {
+        for (const auto& [fen, expected] : cases) {
+            EvalTable transposition_table;
+            transposition_table.set_size(transposition_table_size);
+            std::vector<chess::Board> traversed;
+            Container container;
+            Search search(container.create(0), chess::Board(fen), container, traversed, transposition_table, evaluator, num_simulations, threads, 16);
+            search.startSearch(false);
+
+            std::string best = "none";
+            int most_visits = -1;
+            const uint16_t num_edges = search.rootNode->edgeCount();
+            for (uint16_t i = 0; i < num_edges; ++i) {
+                const Node* child = search.rootNode->edges[i].child.load(std::memory_order_acquire);
+                if (child != nullptr && child->getVisits() > most_visits) {
+                    most_visits = child->getVisits();
+                    best = chess::uci::moveToUci(search.rootNode->edges[i].move);
+                }
+            }
+            const int visits = search.rootNode->getVisits();
+            const bool ok = visits == static_cast<int>(num_simulations) && best == expected;
+            std::cout << (ok ? "PASS " : "FAIL ") << fen << ", " << threads << " threads: " << visits << '/' << num_simulations
+                      << " visits, best move " << best << " (expected " << expected << ")\n";
+            passed = passed && ok;
+        }
+    }
+    return passed;
+}
+
+void humanGame(const model::Evaluator& evaluator) {
 
     unsigned int time_per_move, show_tl;
 
@@ -191,15 +268,18 @@ void humanGame(torch::jit::script::Module& nnet, torch::Device device) {
         }
     }
     chess::Board startState = chess::Board(test_positions[0]);
-    TranspositionTable<uint64_t, std::pair<std::unordered_map<chess::Move, float>, float>> transposition_table;
+    EvalTable transposition_table;
     transposition_table.set_size(transposition_table_size);
     std::vector<chess::Move> moves = {};
     std::vector<chess::Board> traversed = {};
-    unsigned int num_simulations = 10000, nn_cache_size = 256;
+    unsigned int num_simulations = 10000, nn_cache_size = static_cast<unsigned int>(nn_batch_size);
 
     clearTerminal();
     std::cout << startState << "\n";
-    uint8_t progress = 0;
+    // one search for the whole game, the subtree under each played move carries over to the next search
+    Container container;
+    auto rootNode = container.create(0);
+    auto newSearch = Search(rootNode, startState, container, traversed, transposition_table, evaluator, num_simulations, search_threads, nn_cache_size, true);
     for (int turns = 0; turns < 256; ++turns) {
         if (startState.isGameOver().second == chess::GameResult::DRAW) {
             std::cout << "\n=== DRAW ===\n";
@@ -221,14 +301,9 @@ void humanGame(torch::jit::script::Module& nnet, torch::Device device) {
             std::cin >> move;
             try {
                 Move m = uci::parseSan(startState, move);
-                if (startState.isCapture(m) || startState.at(m.from()) == chess::PieceType::PAWN) {
-                    progress = 0;
-                } else {
-                    progress += 1;
-                }
                 startState.makeMove(m);
                 moves.push_back(m);
-                traversed.push_back(startState);
+                newSearch.makeMove(m);
                 clearTerminal();
                 std::cout << "Game History: ";
                 for (auto& m : moves) {
@@ -242,9 +317,6 @@ void humanGame(torch::jit::script::Module& nnet, torch::Device device) {
                 std::cout << "Invalid Move\n";
             }
         }
-        Container container;
-        auto rootNode = new Node(container, startState, progress);
-        auto newSearch = Search(rootNode, container, traversed, transposition_table, nnet, device, num_simulations, thread_count, nn_cache_size, true);
         newSearch.startSearch(true, true, std::chrono::seconds(time_per_move));
 
         auto white_win_prob = newSearch.getRootQ()*(1-2*static_cast<int>(startState.sideToMove()));
@@ -260,15 +332,16 @@ void humanGame(torch::jit::script::Module& nnet, torch::Device device) {
         startState.makeMove(move.first);
         moves.push_back(move.first);
         std::cout << startState << "\n";
-        progress = newSearch.rootNode->moves_since_cpm;
-        startState = newSearch.rootNode->state;
 
-        if (tl) { std::cout << "Engine Top Line:\n" << topLine << ", Evaluation = " << probability_to_centipawn(white_win_prob) << '\n'; }
+        if (tl) {
+            std::cout << "Engine Top Line:\n" << topLine << ", Evaluation = " << probability_to_centipawn(white_win_prob) << '\n';
+            std::cout << "Reused Visits: " << newSearch.reused_visits << '\n';
+        }
         myTurn = false;
     }
 }
 
-void testGame(torch::jit::script::Module& nnet, torch::jit::script::Module& old_nnet, torch::Device device) {
+void testGame(const model::Evaluator& evaluator, const model::Evaluator& old_evaluator) {
     
     unsigned int total_games, num_simulations, nn_cache_size;
 
@@ -278,8 +351,9 @@ void testGame(torch::jit::script::Module& nnet, torch::jit::script::Module& old_
     std::cout << "Enter the number of simulations (higher gives more accuracy but longer training time): ";
     std::cin >> num_simulations;
 
-    std::cout << "Enter the eval cache size (higher values will give more breadth but less depth to search and potentially faster training): ";
+    std::cout << "Enter the eval cache size (higher values will give more breadth but less depth to search and potentially faster training, 0 for nn_batch_size=" << nn_batch_size << "): ";
     std::cin >> nn_cache_size;
+    if (nn_cache_size == 0) nn_cache_size = static_cast<unsigned int>(nn_batch_size);
 
     std::string start_pos;
     chess::Board startState;
@@ -303,11 +377,10 @@ void testGame(torch::jit::script::Module& nnet, torch::jit::script::Module& old_
     clearTerminal();
 
     auto p1Color = chess::Color::WHITE;
-    TranspositionTable<uint64_t, std::pair<std::unordered_map<chess::Move, float>, float>> new_transposition_table;
-    TranspositionTable<uint64_t, std::pair<std::unordered_map<chess::Move, float>, float>> old_transposition_table;
+    EvalTable new_transposition_table;
+    EvalTable old_transposition_table;
     new_transposition_table.set_size(transposition_table_size);
     old_transposition_table.set_size(transposition_table_size);
-    std::vector<chess::Board> traversed = {};
 
     // Directory path where files will be created
     std::string directoryPath = "nnet_test_games";
@@ -323,29 +396,30 @@ void testGame(torch::jit::script::Module& nnet, torch::jit::script::Module& old_
         std::string pgn_moves = "";
         int result = 0;
         bool myTurn = (startState.sideToMove() == p1Color);
-        uint8_t progress = 0;
+
+        // each player keeps its own tree for the whole game and follows the opponent's moves in it
+        std::vector<chess::Board> p1_traversed = {};
+        std::vector<chess::Board> p2_traversed = {};
+        Container p1_container;
+        Container p2_container;
+        auto p1Search = Search(p1_container.create(0), startState, p1_container, p1_traversed, new_transposition_table, evaluator, num_simulations, search_threads, nn_cache_size, false);
+        auto p2Search = Search(p2_container.create(0), startState, p2_container, p2_traversed, old_transposition_table, old_evaluator, num_simulations, search_threads, nn_cache_size, false);
         for (int turns = 0; turns < 256; ++turns) {
             std::pair<chess::Move, int> move;
             if (turns%2 == 0) {
                 pgn_moves += std::to_string((turns/2)+1) + ". ";
             }
             if (!myTurn) {
-                Container container;
-                auto rootNode = new Node(container, startState, progress);
-                auto newSearch = Search(rootNode, container, traversed, old_transposition_table, old_nnet, device, num_simulations, thread_count, nn_cache_size, false);
-                newSearch.startSearch(true);
-                std::cout << "P2 Turn, eval = " << probability_to_centipawn(newSearch.getRootQ()*(1-2*static_cast<int>(startState.sideToMove()))) << ", move - ";
-                move = newSearch.selectMove(false, temperature_end, resign_eval_threshold);
-                progress = newSearch.rootNode->moves_since_cpm;
+                p2Search.startSearch(true);
+                std::cout << "P2 Turn, reused = " << p2Search.reused_visits << ", eval = " << probability_to_centipawn(p2Search.getRootQ()*(1-2*static_cast<int>(startState.sideToMove()))) << ", move - ";
+                move = p2Search.selectMove(false, temperature_end, resign_eval_threshold);
+                p1Search.makeMove(move.first);
             }
             else if (myTurn) {
-                Container container;
-                auto rootNode = new Node(container, startState, progress);
-                auto newSearch = Search(rootNode, container, traversed, new_transposition_table, nnet, device, num_simulations, thread_count, nn_cache_size, false);
-                newSearch.startSearch(true);
-                std::cout << "P1 Turn, eval = " << probability_to_centipawn(newSearch.getRootQ()*(1-2*static_cast<int>(startState.sideToMove()))) << ", move - ";
-                move = newSearch.selectMove(false, temperature_end, resign_eval_threshold);
-                progress = newSearch.rootNode->moves_since_cpm;
+                p1Search.startSearch(true);
+                std::cout << "P1 Turn, reused = " << p1Search.reused_visits << ", eval = " << probability_to_centipawn(p1Search.getRootQ()*(1-2*static_cast<int>(startState.sideToMove()))) << ", move - ";
+                move = p1Search.selectMove(false, temperature_end, resign_eval_threshold);
+                p2Search.makeMove(move.first);
             }
             if (move.second != -1) {
                 if (move.second != 1 && startState.sideToMove() == chess::Color::BLACK) {
@@ -445,38 +519,72 @@ std::string findModel(std::string directory_path) {
     return model_path;
 }
 
-int main() {
+// largest difference of a value or legal move prior the native network may have from the fp32 model
+constexpr float NATIVE_TOLERANCE = 1e-3f;
+// positions the parity check evaluates, no multiple of the network's 8 position chunks so a partial chunk is covered
+constexpr size_t NATIVE_CHECK_POSITIONS = 19;
+
+/*
+    Evaluates the test positions and positions after their first moves through both the native
+    network and the fp32 torch model, the same batch filled the way searches fill theirs
+    @return Largest difference between their values and legal move priors
+*/
+float nativeDifference(const std::shared_ptr<const native::Network>& network, const torch::jit::script::Module& nnet) {
+    std::vector<chess::Board> boards;
+    for (const auto& fen : test_positions) boards.emplace_back(fen);
+    for (size_t i = 0; boards.size() < NATIVE_CHECK_POSITIONS; ++i) {
+        chess::Movelist moves;
+        chess::movegen::legalmoves(moves, boards[i]);
+        if (moves.empty()) continue;
+        auto child = boards[i];
+        child.makeMove(moves[0]);
+        boards.push_back(child);
+    }
 
-#ifdef _WIN32
-    // Check if running as administrator and request elevation if needed
-    if (!isRunningAsAdmin()) {
-        std::cout << "This program requires administrator privileges to run properly." << std::endl;
-        std::cout << "Attempting to request administrator privileges..." << std::endl;
-        
-        if (requestAdminPrivileges()) {
-            // Exit current instance - the elevated instance will continue
-            return 0;
-        } else {
-            std::cout << "Failed to obtain administrator privileges. Program may not function correctly." << std::endl;
-            std::cout << "Press Enter to continue anyway, or close the program..." << std::endl;
-            std::cin.get();
+    const auto count = static_cast<unsigned int>(boards.size());
+    const unsigned int policy_size = PLANES * BOARD_SIZE * BOARD_SIZE;
+    auto fill = [&](model::BatchBuffer& batch) {
+        const RootHistory no_history;
+        for (unsigned int slot = 0; slot < count; ++slot) {
+            auto board = boards[slot];
+            // a single position history never walks the tree, no node is needed
+            EncodedState(board, nullptr, no_history, 1).write(batch, slot);
+            chess::Movelist moves;
+            chess::movegen::legalmoves(moves, board);
+            int indices[model::MAX_LEGAL_MOVES];
+            for (int i = 0; i < moves.size(); ++i) indices[i] = policy_map::move_to_index(moves[i], board.sideToMove());
+            batch.setLegal(slot, indices, static_cast<unsigned int>(moves.size()));
+        }
+        batch.size = count;
+    };
+    model::BatchBuffer native_batch(count, EncodedState::planeCount(1), policy_size, torch::kCPU, packed_input != 0, torch::kFloat32);
+    model::BatchBuffer torch_batch(count, EncodedState::planeCount(1), policy_size, torch::kCPU, packed_input != 0, torch::kFloat32);
+    fill(native_batch);
+    fill(torch_batch);
+    model::NativeEvaluator(network).evaluate(native_batch);
+    model::TorchEvaluator(nnet, torch::kCPU, torch::kFloat32).evaluate(torch_batch);
+
+    float largest = 0.0f;
+    for (unsigned int slot = 0; slot < count; ++slot) {
+        largest = std::max(largest, std::abs(native_batch.value(slot) - torch_batch.value(slot)));
+        for (unsigned int i = 0; i < model::MAX_LEGAL_MOVES; ++i) {
+            largest = std::max(largest, std::abs(native_batch.priors(slot)[i] - torch_batch.priors(slot)[i]));
         }
-    } else {
-        std::cout << "Running with administrator privileges." << std::endl;
     }
-#endif
-
-    ConfigParser parser("params.txt");
-    parser.config_params();
-    
-    std::cout << "Configuration parameters loaded." << std::endl;
+    return largest;
+}
 
-    // _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
+/*
+    Loads the current model and sets it up for the configured backend and precision
+    @return Evaluator of the model, nullptr if it cannot be loaded
+    @param shape: set to the device and precision the model runs in
+*/
+std::unique_ptr<model::Evaluator> loadModel(model::InferenceShape& shape) {
     std::string model_path = findModel(model_directory + "/current_model");
     if (model_path.empty()) {
         std::cerr << "Failed to find model file in: " << model_directory + "/current_model" << std::endl;
         std::cerr << "Please ensure there is a .pt, .pth, or .model file in the current_model directory." << std::endl;
-        return -1;
+        return nullptr;
     }
     
     // Load the model
@@ -492,13 +600,13 @@ int main() {
 
     } catch (const c10::Error& e) {
         std::cerr << "LibTorch error loading the model: " << e.what() << std::endl;
-        return -1;
+        return nullptr;
     } catch (const std::exception& e) {
         std::cerr << "Standard exception while loading the model: " << e.what() << std::endl;
-        return -1;
+        return nullptr;
     } catch (...) {
         std::cerr << "Unknown error loading the model\n";
-        return -1;
+        return nullptr;
     }
 
     torch::Device device = torch::kCPU;
@@ -510,59 +618,171 @@ int main() {
         std::cout << "CUDA not available. Using CPU.\n";
     }
 
-    nnet.to(device, torch::kHalf);
-    std::cout << "Model using half precision.\n";
+    // the native network replaces libtorch for evaluation only, made from the current model by model/export.py --native
+    std::shared_ptr<const native::Network> native_network;
+    if (inference_backend == "native") {
+        const std::string native_path = model_directory + "/current_model/native/network.bin";
+        try {
+            if (!device.is_cpu()) throw std::runtime_error("the native backend runs on the cpu only");
+            native_network = std::make_shared<const native::Network>(native_path);
+            if (native_network->planes() != EncodedState::planeCount(1) || native_network->policySize() != PLANES * BOARD_SIZE * BOARD_SIZE) {
+                throw std::runtime_error(native_path + " does not match the engine's input and policy sizes");
+            }
+            std::cout << "Native network loaded from " << native_path << ", " << native::kernels::INSTRUCTION_SET << " kernels\n";
+            // the weight file may be stale or the kernels wrong, either way the model itself is the reference
+            nnet.to(device, torch::kFloat32);
+            const float difference = nativeDifference(native_network, nnet);
+            if (!(difference <= NATIVE_TOLERANCE)) {
+                throw std::runtime_error("it differs from the model by " + std::to_string(difference) + ", more than " + std::to_string(NATIVE_TOLERANCE));
+            }
+            std::cout << "Native network matches the model within " << difference << " on " << NATIVE_CHECK_POSITIONS << " positions\n";
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to load the native network, using libtorch: " << e.what() << std::endl;
+            native_network.reset();
+        }
+    }
+
+    // searches encode one position per leaf, see Search::position_history
+    auto precision = native_network ? model::Precision::FP32 : model::selectPrecision(nnet, device, inference_precision, EncodedState::planeCount(1),
+        PLANES * BOARD_SIZE * BOARD_SIZE, packed_input != 0);
+    if (precision == model::Precision::INT8) {
+        // made from the current model by model/quantize.py, the quantized weights are not converted
+        std::string int8_path = findModel(model_directory + "/current_model/int8");
+        try {
+            if (int8_path.empty()) throw std::runtime_error("no int8 model in " + model_directory + "/current_model/int8");
+            nnet = torch::jit::load(int8_path);
+            model_path = int8_path;
+        } catch (const std::exception& e) {
+            std::cerr << "Failed to load the int8 model, using fp32: " << e.what() << std::endl;
+            precision = model::Precision::FP32;
+        }
+    }
+    if (precision != model::Precision::INT8) nnet.to(device, model::scalarType(precision));
+    std::cout << "Model using " << model::precisionName(precision) << " precision.\n";
+    if (packed_input == 0) {
+        const bool wide = native_network || model::scalarType(precision) == torch::kFloat32;
+        std::cout << "Inputs unpacked with the " << (wide ? bit_unpack::PATH32 : bit_unpack::PATH16) << " kernel.\n";
+    }
+    inference_precision = model::precisionName(precision);
+    shape = {device, precision, EncodedState::planeCount(1), PLANES * BOARD_SIZE * BOARD_SIZE, packed_input != 0};
+    if (native_network) return std::make_unique<model::NativeEvaluator>(native_network);
+    nnet = model::optimizeForInference(nnet, model_path, shape);
+    return std::make_unique<model::TorchEvaluator>(nnet, device, model::scalarType(precision));
+}
+
+/*
+    Loads the old model for test games, in the device and precision of the current one
+    @return Evaluator of the old model, nullptr if it cannot be loaded
+*/
+std::unique_ptr<model::Evaluator> loadOldModel(const model::InferenceShape& shape) {
+    std::string old_model_path = findModel(model_directory + "/old_model");
+    if (old_model_path.empty()) {
+        std::cerr << "Failed to find old model file in: " << model_directory + "/old_model" << std::endl;
+        std::cerr << "Please ensure there is a .pt, .pth, or .model file in the old_model directory." << std::endl;
+        return nullptr;
+    }
+    
+    // Load the model
+    torch::jit::script::Module old_nnet;
+
+    try {
+        old_nnet = torch::jit::load(old_model_path);
+        std::cout << "Old model loaded successfully\n";
+
+    } catch (const c10::Error& e) {
+        std::cerr << "LibTorch error loading the old model: " << e.what() << std::endl;
+        return nullptr;
+    } catch (const std::exception& e) {
+        std::cerr << "Standard exception while loading the old model: " << e.what() << std::endl;
+        return nullptr;
+    } catch (...) {
+        std::cerr << "Unknown error loading the old model\n";
+        return nullptr;
+    }
+
+    // the old model is never quantized, int8 runs it in fp32
+    auto old_shape = shape;
+    if (shape.precision == model::Precision::INT8) old_shape.precision = model::Precision::FP32;
+    old_nnet.to(shape.device, model::scalarType(old_shape.precision));
+    old_nnet = model::optimizeForInference(old_nnet, old_model_path, old_shape);
+    return std::make_unique<model::TorchEvaluator>(old_nnet, shape.device, model::scalarType(old_shape.precision));
+}
+
+// @return Deterministic stand in for a model, with the artificial latency of params.txt
+std::unique_ptr<model::Evaluator> mockModel() {
+    std::cout << "Using the mock evaluator, " << mock_batch_latency_us << "us per batch and " << mock_position_latency_us << "us per position.\n";
+    return std::make_unique<model::MockEvaluator>(std::chrono::microseconds(mock_batch_latency_us), std::chrono::microseconds(mock_position_latency_us));
+}
+
+int main() {
+
+#ifdef _WIN32
+    // Check if running as administrator and request elevation if needed
+    if (!isRunningAsAdmin()) {
+        std::cout << "This program requires administrator privileges to run properly." << std::endl;
+        std::cout << "Attempting to request administrator privileges..." << std::endl;
+        
+        if (requestAdminPrivileges()) {
+            // Exit current instance - the elevated instance will continue
+            return 0;
+        } else {
+            std::cout << "Failed to obtain administrator privileges. Program may not function correctly." << std::endl;
+            std::cout << "Press Enter to continue anyway, or close the program..." << std::endl;
+            std::cin.get();
+        }
+    } else {
+        std::cout << "Running with administrator privileges." << std::endl;
+    }
+#endif
+
+    ConfigParser parser("params.txt");
+    parser.config_params();
+    
+    std::cout << "Configuration parameters loaded." << std::endl;
+
+    // _CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
+    // the mock backend needs no model, it measures the search on its own
+    model::InferenceShape shape;
+    std::unique_ptr<model::Evaluator> evaluator = inference_backend == "mock" ? mockModel() : loadModel(shape);
+    if (!evaluator) return -1;
 
     int choice = -1;
     while (true) {
-        std::cout << "Self Play(0), Human Game(1), Test Game(2), or Test Position(3): ";
+        std::cout << "Self Play(0), Human Game(1), Test Game(2), Test Position(3), Tune(4), or Check Search(5): ";
         std::cin >> choice;
 
         if (choice == 0) {
             clearTerminal();
-            selfPlay(nnet, device);
+            selfPlay(*evaluator);
             break;
         }
         else if (choice == 1) {
             clearTerminal();
-            humanGame(nnet, device);
+            humanGame(*evaluator);
             break;
         }
         else if (choice == 2) {
             clearTerminal();
-            std::string old_model_path = findModel(model_directory + "/old_model");
-            if (old_model_path.empty()) {
-                std::cerr << "Failed to find old model file in: " << model_directory + "/old_model" << std::endl;
-                std::cerr << "Please ensure there is a .pt, .pth, or .model file in the old_model directory." << std::endl;
-                return -1;
-            }
-            
-            // Load the model
-            torch::jit::script::Module old_nnet;
-
-            try {
-                old_nnet = torch::jit::load(old_model_path);
-                std::cout << "Old model loaded successfully\n";
-
-            } catch (const c10::Error& e) {
-                std::cerr << "LibTorch error loading the old model: " << e.what() << std::endl;
-                return -1;
-            } catch (const std::exception& e) {
-                std::cerr << "Standard exception while loading the old model: " << e.what() << std::endl;
-                return -1;
-            } catch (...) {
-                std::cerr << "Unknown error loading the old model\n";
-                return -1;
-            }
-
-            old_nnet.to(device, torch::kHalf);
+            auto old_evaluator = inference_backend == "mock" ? mockModel() : loadOldModel(shape);
+            if (!old_evaluator) return -1;
 
-            testGame(nnet, old_nnet, device);
+            testGame(*evaluator, *old_evaluator);
             break;
         }
         else if (choice == 3) {
             clearTerminal();
-            testPosition(nnet, device);
+            testPosition(*evaluator);
+            break;
+        }
+        else if (choice == 4) {
+            clearTerminal();
+            tune(*evaluator);
+            break;
+        }
+        else if (choice == 5) {
+            clearTerminal();
+            // a failed check exits with an error, so scripts can run it as a regression test
+            if (!checkSearch()) return 1;
             break;
         }
         else {
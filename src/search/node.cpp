@@ -2,15 +2,16 @@
 
 
 
-Node::Node(Container& container, chess::Board state, uint8_t moves_since_cpm, chess::Move move, std::vector<Node*> prev_list, float policy)
-    : state(state), move(move), prev_list(prev_list), policy(policy), moves_since_cpm(moves_since_cpm) {
-        container.push(this);
+Node::Node(uint8_t moves_since_cpm, chess::Move move, Node* parent)
+    : move(move), parent(parent), moves_since_cpm(moves_since_cpm) {
+        depth = parent != nullptr ? parent->depth + 1 : 0;
         progress_mult = cpmToMult(moves_since_cpm);
     }
 
-std::pair<bool, float> Node::get_terminal_val() const {
+// @param board: position of this node
+std::pair<bool, float> Node::get_terminal_val(const chess::Board& board) const {
     float val;
-    auto check = state.isGameOver();
+    auto check = board.isGameOver();
     if (check.second != chess::GameResult::NONE) {
         if (check.second == chess::GameResult::DRAW) {
             val = 0.0;
@@ -22,35 +23,184 @@ std::pair<bool, float> Node::get_terminal_val() const {
     return std::make_pair(false, 0.0);
 }
 
-void Node::expand(chess::Move newMove, float policy, Container& container) {
+// Creates the unpublished edges of a leaf, their priors are filled in by expand once the position is evaluated.
+void Node::setMoves(const chess::Movelist& movelist) {
     std::lock_guard<std::mutex> guard(expand_lock);
-    auto stateCopy = state;
+    if (edges != nullptr) return;
+    edges = std::make_unique<Edge[]>(movelist.size());
+    for (int i = 0; i < movelist.size(); ++i) {
+        edges[i].move = movelist[i];
+    }
+    num_moves = static_cast<uint16_t>(movelist.size());
+}
+
+chess::Movelist Node::getMoves() const {
+    chess::Movelist movelist;
+    for (uint16_t i = 0; i < num_moves; ++i) {
+        movelist.add(edges[i].move);
+    }
+    return movelist;
+}
+
+// Returns the child behind an edge, creating the node the first time the edge is visited.
+// @param board: position of this node
+Node* Node::getChild(const uint16_t index, Container& container, const chess::Board& board) {
+    Edge& edge = edges[index];
+    Node* child = edge.child.load(std::memory_order_acquire);
+    if (child != nullptr) return child;
+
+    std::lock_guard<std::mutex> guard(expand_lock);
+    child = edge.child.load(std::memory_order_relaxed);
+    if (child != nullptr) return child;
+
     uint8_t progress;
-    // bool check_or_cap = false;
-    if (stateCopy.isCapture(newMove)) {
+    if (board.isCapture(edge.move)) {
         progress = 0;
-        // check_or_cap = true;
     } 
-    else if (stateCopy.at(newMove.from()) == chess::PieceType::PAWN) {
+    else if (board.at(edge.move.from()) == chess::PieceType::PAWN) {
         progress = 0;
     }
     else {
         progress = moves_since_cpm + 1;
     }
 
-    stateCopy.makeMove(newMove);
-    // check_or_cap = stateCopy.inCheck();
-    auto new_prevs = prev_list;
-    new_prevs.emplace_back(this);
-    children.emplace_back(new Node(container, stateCopy, progress, newMove, new_prevs, policy));
+    child = container.create(progress, edge.move, this);
+    edge.child.store(child, std::memory_order_release);
+    return child;
 }
 
 void Node::backpropagate(float val, Container& container) {
-    addToVal(val);
-    ++visits;
-    virtual_loss = false;
+    completeVisit(val);
+
+    // stops below the root, whose visits are counted when a search starts from it
+    Node* parent = getParent();
+    if (parent != nullptr && parent->getParent() != nullptr) {
+        parent->backpropagate(-val, container);
+    }
+}
+
+// Backs a collided playout out of the path it selected, nothing is counted toward visits or value.
+void Node::cancelVisit() {
+    removeInFlight();
+
+    Node* parent = getParent();
+    if (parent != nullptr && parent->getParent() != nullptr) {
+        parent->cancelVisit();
+    }
+}
+
+// Reserves the next slot of the calling thread's slab, a slab is dropped by its thread as soon as it is full.
+std::pair<Container::Slab*, uint32_t> Container::allocate() {
+    struct ThreadSlab {
+        uint64_t owner = UINT64_MAX;
+        Slab* slab = nullptr;
+    };
+    thread_local ThreadSlab local;
+    const uint64_t owner = owner_id.load(std::memory_order_relaxed);
+    if (local.owner != owner || local.slab == nullptr) {
+        local.slab = newSlab();
+        local.owner = owner;
+    }
+    Slab* slab = local.slab;
+    const uint32_t index = slab->used.load(std::memory_order_relaxed);
+    if (index + 1 == Slab::CAPACITY) {
+        local.slab = nullptr;
+    }
+    return std::make_pair(slab, index);
+}
+
+Container::Slab* Container::newSlab() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!free_slabs.empty()) {
+        Slab* slab = free_slabs.back();
+        free_slabs.pop_back();
+        slab->free = false;
+        slab->owned = true;
+        return slab;
+    }
+    Slab* slab = new (::operator new(sizeof(Slab), std::align_val_t(Slab::BYTES))) Slab();
+    slab->owned = true;
+    slabs.push_back(slab);
+    return slab;
+}
+
+// Ends a thread's ownership of a full slab, it is recycled right away if its nodes are already gone.
+void Container::disown(Slab* slab) {
+    std::lock_guard<std::mutex> guard(lock);
+    slab->owned = false;
+    if (slab->live.load(std::memory_order_acquire) == 0) recycle(slab);
+}
+
+// Puts an unowned slab without live nodes on the free list, the caller holds the lock.
+void Container::recycle(Slab* slab) {
+    slab->used.store(0, std::memory_order_relaxed);
+    slab->free = true;
+    free_slabs.push_back(slab);
+}
 
-    if (getDepth() > 1) {
-        getParent()->backpropagate(-val, container);
+/*
+    Hands back every slab threads are still allocating from, so partly filled slabs are recycled once
+    their nodes are released instead of being stranded when their threads move on or exit. Threads
+    take a fresh slab on their next allocation. No thread may be creating nodes of this container
+    meanwhile, the reclaimer may keep releasing them.
+*/
+void Container::closeSlabs() {
+    std::lock_guard<std::mutex> guard(lock);
+    owner_id.store(next_id.fetch_add(1, std::memory_order_relaxed), std::memory_order_relaxed);
+    for (auto slab : slabs) {
+        if (!slab->owned) continue;
+        slab->owned = false;
+        if (slab->live.load(std::memory_order_acquire) == 0) recycle(slab);
+    }
+}
+
+// Destroys a node in place, its slab is recycled once no thread owns it and it holds no live nodes.
+void Container::release(Node* node) {
+    Slab* slab = slabOf(node);
+    const uint32_t index = static_cast<uint32_t>(node - slab->at(0));
+    node->~Node();
+    slab->alive[index] = false;
+    live_nodes.fetch_sub(1, std::memory_order_relaxed);
+    if (slab->live.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!slab->owned && !slab->free && slab->live.load(std::memory_order_acquire) == 0) recycle(slab);
+    }
+}
+
+/*
+    Queues a subtree to be released by the reclaimer thread, which is started on first use
+    @param root: top of the discarded subtree, must no longer be reachable from the search
+    @param keep: child left alive along with its own subtree
+*/
+void Container::reclaim(Node* root, const Node* keep) {
+    std::lock_guard<std::mutex> guard(reclaim_lock);
+    pending.emplace_back(root, keep);
+    if (!reclaimer.joinable()) {
+        reclaimer = std::thread(&Container::reclaimLoop, this);
+    }
+    reclaim_cv.notify_one();
+}
+
+// Releases queued subtrees depth first until the container is destroyed and nothing is left pending.
+void Container::reclaimLoop() {
+    std::unique_lock<std::mutex> guard(reclaim_lock);
+    while (true) {
+        reclaim_cv.wait(guard, [this] { return stopping || !pending.empty(); });
+        if (pending.empty()) return;
+        const auto [root, keep] = pending.back();
+        pending.pop_back();
+        guard.unlock();
+
+        std::vector<Node*> stack = {root};
+        while (!stack.empty()) {
+            Node* node = stack.back();
+            stack.pop_back();
+            for (uint16_t i = 0; i < node->num_moves; ++i) {
+                Node* child = node->edges[i].child.load(std::memory_order_acquire);
+                if (child != nullptr && child != keep) stack.push_back(child);
+            }
+            release(node);
+        }
+        guard.lock();
     }
 }
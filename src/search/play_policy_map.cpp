@@ -27,29 +27,56 @@ std::unique_ptr<float[]> policy_map::get_move_to_policy(std::unordered_map<chess
     return policyIndex;
 }
 
-std::unordered_map<chess::Move, float> policy_map::policy_to_moves(const std::vector<float> policy, const chess::Board& state) {
-    int c = static_cast<int>(state.sideToMove());
+std::unordered_map<chess::Move, float> policy_map::policy_to_moves(const float* policy, const chess::Movelist& moves, chess::Color color) {
     std::unordered_map<chess::Move, float> move_map;
-    chess::Movelist moves;
-    chess::movegen::legalmoves(moves, state);
 
-    float max_policy = -std::numeric_limits<float>::infinity();
     for (int i = 0; i < moves.size(); ++i) {
         const auto move = moves[i];
-        int from_rank_index = (c == 0 ? static_cast<int>(move.from().rank()) : 7 - static_cast<int>(move.from().rank()));
-        int from_file_index = static_cast<int>(move.from().file());
-        int dest_rank_index = (c == 0 ? static_cast<int>(move.to().rank()) : 7 - static_cast<int>(move.to().rank()));
-        int dest_file_index = static_cast<int>(move.to().file());
-        int promotion_to_int = promotion_to_index(move.promotionType());
-        for (int plane = 0; plane < PLANES; ++plane) {
-            bool rightSquare = (policyMap[(from_rank_index*BOARD_SIZE*PLANES) + (from_file_index*PLANES) + plane] == ((BOARD_SIZE*dest_rank_index) + dest_file_index)*promotion_to_int);
-            if (rightSquare) {
-                auto pi_i = policy[(from_rank_index*BOARD_SIZE*PLANES) + (from_file_index*PLANES) + plane];
-                if (pi_i > max_policy) { max_policy = pi_i; }
-                move_map.insert({move, pi_i});
-                break;
-            }
+        const int index = move_to_index(move, color);
+        if (index >= 0) {
+            move_map.insert({move, policy[index]});
         }
     }
     return Softmax(move_map);
 }
+
+namespace {
+    // policy index of every (from, to, promotion) from the side to move's view, -1 where no plane matches
+    struct MoveIndexTable {
+        std::array<int16_t, BOARD_SIZE * BOARD_SIZE * BOARD_SIZE * BOARD_SIZE * 5> index;
+
+        MoveIndexTable() {
+            index.fill(-1);
+            for (int from = 0; from < BOARD_SIZE * BOARD_SIZE; ++from) {
+                for (int to = 0; to < BOARD_SIZE * BOARD_SIZE; ++to) {
+                    for (int promotion = 1; promotion <= 4; ++promotion) {
+                        // the first matching plane, as the policy was always read
+                        for (int plane = 0; plane < PLANES; ++plane) {
+                            if (policyMap[from * PLANES + plane] == to * promotion) {
+                                index[(from * BOARD_SIZE * BOARD_SIZE + to) * 5 + promotion] = static_cast<int16_t>(from * PLANES + plane);
+                                break;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    const MoveIndexTable move_index_table;
+}
+
+/*
+    @return Index of a move in the network's policy output, -1 if no policy plane encodes it
+    @param color: side to move, black's moves are mirrored like its input planes
+*/
+int policy_map::move_to_index(chess::Move move, chess::Color color) {
+    const int c = static_cast<int>(color);
+    const int from_rank_index = (c == 0 ? static_cast<int>(move.from().rank()) : 7 - static_cast<int>(move.from().rank()));
+    const int from_file_index = static_cast<int>(move.from().file());
+    const int dest_rank_index = (c == 0 ? static_cast<int>(move.to().rank()) : 7 - static_cast<int>(move.to().rank()));
+    const int dest_file_index = static_cast<int>(move.to().file());
+    const int from = BOARD_SIZE * from_rank_index + from_file_index;
+    const int to = BOARD_SIZE * dest_rank_index + dest_file_index;
+    return move_index_table.index[(from * BOARD_SIZE * BOARD_SIZE + to) * 5 + promotion_to_index(move.promotionType())];
+}
@@ -1,13 +1,17 @@
 #include "include/search/search.hpp"
 #include "include/utils/random.hpp"
 
-Search::Search(Node* rootNode, Container& container, std::vector<chess::Board>& traversed,
-               TranspositionTable<uint64_t, std::pair<std::unordered_map<chess::Move, float>, float>>& transposition_table, 
-               torch::jit::script::Module& nnet, torch::Device device, unsigned int num_simulations, 
+Search::Search(Node* rootNode, const chess::Board& rootState, Container& container, std::vector<chess::Board>& traversed,
+               EvalTable& transposition_table, 
+               const model::Evaluator& evaluator, unsigned int num_simulations, 
                unsigned int num_threads, unsigned int nn_batch_size, bool depthVerbose, const uint8_t position_history)
-    : rootNode(rootNode), container(container), traversed(traversed), transposition_table(transposition_table), 
-      nnet(nnet), device(device), num_simulations(num_simulations + 1), num_threads(num_threads), 
-      nn_batch_size(nn_batch_size), threadManager(*this), depthVerbose(depthVerbose), position_history(position_history) {}
+    : num_threads(num_threads), num_simulations(num_simulations + 1),
+      rootNode(rootNode), rootState(rootState), root_id(next_root_id.fetch_add(1)),
+      executors(model::executorsFor(evaluator, {static_cast<unsigned int>(std::max(inference_executors, 1)), intra_op_threads, pin_executor_threads != 0})),
+      container(container), traversed(traversed), transposition_table(transposition_table),
+      nn_batch_size(nn_batch_size), depthVerbose(depthVerbose),
+      // the encoder supports 1 to MAX_HISTORY positions
+      position_history(std::clamp<uint8_t>(position_history, 1, MAX_HISTORY)), threadManager(*this) {}
 
 // Retrieves all legal chess moves for a given board state. This is used to determine possible next moves from any given position.
 chess::Movelist Search::get_moves(const chess::Board& state) const {
@@ -17,162 +21,168 @@ chess::Movelist Search::get_moves(const chess::Board& state) const {
 }
 
 // Expands a leaf node in the search tree using the neural network to evaluate the position. 
-void Search::expand_leaf(Node* node, std::unique_lock<std::mutex> lock) {
+// @param board: position of node
+// The caller has claimed the node through in_nnet, no other thread expands it meanwhile.
+void Search::expand_leaf(Node* node, chess::Board& board) {
     // Initialization of the neural network evaluation structure
-    std::pair<std::unordered_map<chess::Move, float>, float> nn_eval;
-    auto state_hash = node->state.hash();
-    if (transposition_table.contains(state_hash)) {
+    CompactEval nn_eval;
+    auto state_hash = board.hash();
+    auto movelist = get_moves(board);
+    if (transposition_table.probe(state_hash, nn_eval)) {
         // If evaluation exists, use it
-        nn_eval = transposition_table.getHash(state_hash);
-        auto movelist = get_moves(node->state);
-        for (const auto &move : movelist) {
-            node->expand(move, nn_eval.first[move], container);
-        }
-        node->in_nnet.store(false);
-        lock.unlock();
-        node->nnet_cv.notify_all();
-        // std::cout << "Thread " << std::this_thread::get_id() << " notified all!\n";
-        node->backpropagate(nn_eval.second, container);
-        if (depthVerbose) {checkMaxDepth(node->getDepth());}
+        node->expand(movelist, [&nn_eval](const chess::Move move) { return nn_eval.prior(move); });
+        node->backpropagate(nn_eval.value(), container);
+        if (depthVerbose) {checkMaxDepth(node);}
     } else {
-        // Otherwise, mark the node for neural network evaluation
-        lock.unlock();
-        if (depthVerbose) {checkMaxDepth(node->getDepth());}
-        node->in_nnet.store(true);
-        pushToCache(EncodedState(node, traversed, position_history).toTensor(), node);
-        nn_eval_request(nn_batch_size);
+        // Otherwise, mark the node for neural network evaluation, its edges are published with the result
+        node->setMoves(movelist);
+        if (depthVerbose) {checkMaxDepth(node);}
+        inference->submit(EncodedState(board, node, root_history, position_history), {node, state_hash, board.sideToMove()});
     }
 }
 
 // Expands the root node of the search tree, optionally applying Dirichlet noise for exploration enhancement.
 void Search::expandRoot(Node* root, const bool noise) {
 
-    std::unique_lock<std::mutex> guard(root->lock);
-    std::pair<std::unordered_map<chess::Move, float>, float> nn_eval;
-
-    auto state_hash = root->state.hash();
-    if (transposition_table.contains(state_hash)) {
-        nn_eval = transposition_table.getHash(state_hash);
-        auto movelist = get_moves(root->state);
-        auto policy = noise ? applyDirichletNoise(nn_eval.first, root_dirichlet_alpha, root_dirichlet_epsilon) : nn_eval.first;
-        for (const auto &move : movelist) {
-            root->expand(move, policy[move], container);
+    if (!root->is_leaf_node()) {
+        // root reused from the previous move, its edges hold the raw priors it got as an inner node
+        if (noise) {
+            const uint16_t num_edges = root->edgeCount();
+            std::unordered_map<chess::Move, float> policy;
+            for (uint16_t i = 0; i < num_edges; ++i) {
+                policy[root->edges[i].move] = root->edges[i].policy;
+            }
+            policy = applyDirichletNoise(policy, root_dirichlet_alpha, root_dirichlet_epsilon);
+            for (uint16_t i = 0; i < num_edges; ++i) {
+                root->edges[i].policy = policy[root->edges[i].move];
+            }
         }
-        guard.unlock();
+        return;
+    }
+    CompactEval nn_eval;
+
+    auto state_hash = rootState.hash();
+    auto movelist = get_moves(rootState);
+    if (transposition_table.probe(state_hash, nn_eval)) {
+        auto policy = nn_eval.toMoveMap(movelist);
+        policy = noise ? applyDirichletNoise(policy, root_dirichlet_alpha, root_dirichlet_epsilon) : policy;
+        root->expand(movelist, [&policy](const chess::Move move) { return policy[move]; });
     } else {
+        root->setMoves(movelist);
         root->in_nnet.store(true);
-        pushToCache(EncodedState(root, traversed, position_history).toTensor(), root);
-        auto evaluation = model::evaluate(nn_cache, nnet, device);
-        nn_evaluations = evaluation;
-        threadManager.evaluateRoot(noise);
+        // evaluated on its own before the inference stage starts, every playout needs the root's edges
+        auto board = rootState;
+        if (root_batch.capacity == 0) {
+            root_batch = model::BatchBuffer(1, EncodedState::planeCount(position_history), policySize, executors.getDevice(), packed_input != 0, executors.inputType());
+        }
+        model::BatchBuffer& batch = root_batch;
+        EncodedState(board, root, root_history, position_history).write(batch, 0);
+        int indices[model::MAX_LEGAL_MOVES];
+        for (uint16_t i = 0; i < root->num_moves; ++i) {
+            indices[i] = policy_map::move_to_index(root->edges[i].move, rootState.sideToMove());
+        }
+        batch.setLegal(0, indices, root->num_moves);
+        batch.size = 1;
+        executors.evaluate(batch);
+        threadManager.evaluateRoot(batch.priors(0), batch.value(0), {root, state_hash, rootState.sideToMove()}, noise);
     }
 }
 
-// Recursive method for expanding nodes starting from a specific node. It selects the best node to expand based on a heuristic.
-void Search::expand(Node* node) {
-    Node* selection = nullptr;
-    auto terminal = node->get_terminal_val();
-
-    std::unique_lock<std::mutex> guard(node->lock);
-    // Add timeout to prevent infinite waiting
-    auto wait_result = node->nnet_cv.wait_for(guard, std::chrono::seconds(3), [node] { 
-        return !node->in_nnet.load(); 
-    });
-    
-    if (!wait_result) {
-        std::cerr << "[ERROR] Timeout waiting for neural network evaluation on node at depth " 
-                  << static_cast<int>(node->getDepth()) << std::endl;
-        // Force the node to be available if timeout occurs
-        node->in_nnet.store(false);
+/*
+    Recursive method for expanding nodes starting from a specific node. It selects the best node to expand based on a heuristic.
+    @return false if the playout collided with a leaf another thread is evaluating, its in flight visits are backed out
+    @param board: position of node, returned to it before the call ends
+*/
+bool Search::expand(Node* node, chess::Board& board) {
+    if (node->is_leaf_node()) {
+        // only leaves can be terminal, expanded nodes have legal moves
+        auto terminal = node->get_terminal_val(board);
+        if (terminal.first) {
+            // If the node represents a terminal state, backpropagate the result
+            node->backpropagate(terminal.second, container);
+            if (depthVerbose) {checkMaxDepth(node);}
+            return true;
+        }
+        if (node->in_nnet.exchange(true)) {
+            // another thread is already evaluating this leaf, back out instead of waiting for it
+            node->cancelVisit();
+            collisions.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        expand_leaf(node, board);
+        return true;
     }
+    // For internal nodes, select the best child based on a score and recursively expand it
+    Node* selection = selectChild(node, board);
+    board.makeMove(selection->move);
+    const bool completed = expand(selection, board); // Recursively expand the selected node
+    board.unmakeMove(selection->move);
+    return completed;
+}
 
-    if (terminal.first) {
-        guard.unlock();
-        // If the node represents a terminal state, backpropagate the result
-        node->backpropagate(terminal.second, container);
-        if (depthVerbose) {checkMaxDepth(node->getDepth());}
-    } else {
-        if (node->is_leaf_node()) {
-            // If it's a leaf node, try to expand it
-            expand_leaf(node, std::move(guard));
-        } else {
-            // For internal nodes, select the best child based on a score and recursively expand it
-            float highest_puct = -std::numeric_limits<float>::infinity();
-            for (const auto& child : node->children) {
-                float child_val = child->puct_value();
-                if (child_val > highest_puct) {
-                    highest_puct = child_val;
-                    selection = child;
-                }
-            }
-            // Ensure a proper selection and avoid bottlenecks
-            if (selection == nullptr) {
-                nn_eval_request(1);
-                for (const auto& child : node->children) {
-                    float child_val = child->puct_value();
-                    if (child_val >= highest_puct) { // safe selection set, helps avoid bugs especially in positions with few moves
-                        highest_puct = child_val;
-                        selection = child;
-                    }
-                }
-                if (selection == nullptr) {
-                    std::cout << "[WARNING] selection is nullptr\n";
-                    selection = node->children.front();
-                }
+// Picks the edge with the highest PUCT value and returns its child, creating the node on the edge's first visit.
+// @param board: position of node
+Node* Search::selectChild(Node* node, const chess::Board& board) {
+    const uint16_t num_edges = node->edgeCount();
+    int selection = -1;
+    float highest_puct = -std::numeric_limits<float>::infinity();
+    for (uint16_t i = 0; i < num_edges; ++i) {
+        float edge_val = node->puct_value(node->edges[i]);
+        if (edge_val > highest_puct) {
+            highest_puct = edge_val;
+            selection = i;
+        }
+    }
+    // Ensure a proper selection and avoid bottlenecks
+    if (selection == -1) {
+        inference->flush();
+        for (uint16_t i = 0; i < num_edges; ++i) {
+            float edge_val = node->puct_value(node->edges[i]);
+            if (edge_val >= highest_puct) { // safe selection set, helps avoid bugs especially in positions with few moves
+                highest_puct = edge_val;
+                selection = i;
             }
-            selection->virtual_loss = true;
-            guard.unlock();
-            expand(selection); // Recursively expand the selected node
         }
     }
+    Node* child = node->getChild(static_cast<uint16_t>(selection), container, board);
+    child->addInFlight();
+    return child;
 }
 
-// Adjusts the root of the search tree based on the current game state. This involves moving nodes around to reflect the game's progression.
-void Search::move_root(const Node* newRoot) {
+// Adjusts the root of the search tree based on the current game state. The kept subtree is detached in constant time, the rest of the old tree is freed in the background.
+void Search::move_root(Node* newRoot) {
 
     // Move the old root to the traversed container
-    ++total_nodes;
-    auto it = container.list.begin();
-    Node* rootNode = *it;
-    chess::Board rootState = rootNode->state;
     traversed.push_back(rootState);
-    it = container.removeNode(it);
+    rootState.makeMove(newRoot->move);
+    root_id = next_root_id.fetch_add(1);
 
-    // Clean up the tree by removing nodes that are not in the path to the new root
-    while (it != container.list.end()) {
-        ++total_nodes;
-        Node* node = *it;
-        if (!((node->getDepth() == 1 && node == newRoot) || (node->getDepth() > 1 && node->prev_list[1] == newRoot))) {
-            it = container.removeNode(it);
-        } else {
-            if (!node->prev_list.empty()) {
-                node->prev_list.erase(node->prev_list.begin());
-            }
-            ++it;
-        }
-    }
+    newRoot->parent = nullptr;
+    container.reclaim(rootNode, newRoot);
 }
 
 // Selects the next move based on the visit counts of the children of the root node, applying a temperature parameter to influence the selection.
 std::pair<chess::Move, int> Search::selectMove(const bool verbose, double temperature, float resign_threshold) {
-    uint16_t highest_visit_count = 0;
     Node* selection;
-    std::vector<Node*> nodes = {};
     std::vector<float> probabilities = {};
     
     // Precompute temperature inverse for better performance
     const double temperature_inv = 1.0 / temperature;
 
-    for (const auto &child : rootNode->children) {
+    const uint16_t num_edges = rootNode->edgeCount();
+    for (uint16_t i = 0; i < num_edges; ++i) {
+        const Edge& edge = rootNode->edges[i];
+        const Node* child = edge.child.load(std::memory_order_acquire);
+        const int child_visits = child != nullptr ? child->getVisits() : 0;
         // verbose turns on move policy and value outputs to console
         if (verbose) {
             // for debugging
-            int c = static_cast<int>(rootNode->state.sideToMove());
-            int from_rank_index = (c == 0 ? static_cast<int>(child->move.from().rank()) : 7 - static_cast<int>(child->move.from().rank()));
-            int from_file_index = static_cast<int>(child->move.from().file());
-            int dest_rank_index = (c == 0 ? static_cast<int>(child->move.to().rank()) : 7 - static_cast<int>(child->move.to().rank()));
-            int dest_file_index = static_cast<int>(child->move.to().file());
-            int promotion_to_int = promotion_to_index(child->move.promotionType());
+            int c = static_cast<int>(rootState.sideToMove());
+            int from_rank_index = (c == 0 ? static_cast<int>(edge.move.from().rank()) : 7 - static_cast<int>(edge.move.from().rank()));
+            int from_file_index = static_cast<int>(edge.move.from().file());
+            int dest_rank_index = (c == 0 ? static_cast<int>(edge.move.to().rank()) : 7 - static_cast<int>(edge.move.to().rank()));
+            int dest_file_index = static_cast<int>(edge.move.to().file());
+            int promotion_to_int = promotion_to_index(edge.move.promotionType());
             for (int plane = 0; plane < PLANES; ++plane) {
                 bool rightSquare = (policyMap[(from_rank_index*BOARD_SIZE*PLANES) + (from_file_index*PLANES) + plane] == ((BOARD_SIZE*dest_rank_index) + dest_file_index)*promotion_to_int);
                 if (rightSquare) {
@@ -180,14 +190,17 @@ std::pair<chess::Move, int> Search::selectMove(const bool verbose, double temper
                     break;
                 }
             }
-            std::cout << "Move: " << child->move << ", Visits: " << child->visits << ", Policy: " << child->policy << ", Value: " << child->getQ() << ", PUCT Value: " << child->puct_value() << ", M/S CPM: " << static_cast<int>(child->moves_since_cpm) << ", " << child->progress_mult << '\n';
+            std::cout << "Move: " << edge.move << ", Visits: " << child_visits << ", Policy: " << edge.policy << ", Value: " << (child != nullptr ? child->getQ() : 0.0f) << ", PUCT Value: " << rootNode->puct_value(edge);
+            if (child != nullptr) {
+                std::cout << ", M/S CPM: " << static_cast<int>(child->moves_since_cpm) << ", " << child->progress_mult;
+            }
+            std::cout << '\n';
         }
-        nodes.push_back(child);
         // Use precomputed temperature inverse for better performance
-        probabilities.push_back(std::pow((static_cast<long double>(child->visits.load())/static_cast<long double>(rootNode->visits.load())), static_cast<long double>(temperature_inv)));
+        probabilities.push_back(std::pow((static_cast<long double>(child_visits)/static_cast<long double>(rootNode->getVisits())), static_cast<long double>(temperature_inv)));
     }
     // Use a random distribution to select a node based on the computed probabilities
-    selection = nodes[randomDiscrete(probabilities)];
+    selection = rootNode->getChild(static_cast<uint16_t>(randomDiscrete(probabilities)), container, rootState);
 
     // Get game result (-1 if no result yet)
     int result = -1;
@@ -195,8 +208,11 @@ std::pair<chess::Move, int> Search::selectMove(const bool verbose, double temper
         if (getRootQ() < -resign_threshold) {result = 0;}
     }
     else {
-        if (selection->state.isGameOver().second == chess::GameResult::LOSE) {result = 2;}
-        else if (selection->state.isGameOver().second == chess::GameResult::DRAW) {result = 1;}
+        auto selectionState = rootState;
+        selectionState.makeMove(selection->move);
+        const auto gameOver = selectionState.isGameOver().second;
+        if (gameOver == chess::GameResult::LOSE) {result = 2;}
+        else if (gameOver == chess::GameResult::DRAW) {result = 1;}
     }
 
     // Move the root of the search tree to the selected node
@@ -207,10 +223,14 @@ std::pair<chess::Move, int> Search::selectMove(const bool verbose, double temper
 
 // Updates the tree's root to reflect a move made in the game, progressing the game state.
 void Search::makeMove(const chess::Move m) {
-    Node* selection;
-    for (const auto &child : rootNode->children) {
-        if (child->move == m) {
-            selection = child;
+    Node* selection = nullptr;
+    // the root may never have been searched, its edges are still needed to reach the child
+    if (rootNode->edges == nullptr) {
+        rootNode->setMoves(get_moves(rootState));
+    }
+    for (uint16_t i = 0; i < rootNode->num_moves; ++i) {
+        if (rootNode->edges[i].move == m) {
+            selection = rootNode->getChild(i, container, rootState);
             break;
         }
     }
@@ -219,69 +239,37 @@ void Search::makeMove(const chess::Move m) {
     rootNode = selection;
 }
 
-// Adds a node's state to the queue for neural network evaluation, batching evaluations to improve efficiency.
-void Search::nn_eval_request(const unsigned int batch_size) {
-    
-    std::unique_lock<std::mutex> request(request_guard);
-    while (evaluating) evaluating_cv.wait(request);
-
-    if (nn_cache.size() >= batch_size) {
-        // std::cout << "need to evaluate\n";
-        evaluating = true;
-        evaluating_cv.notify_all();
-        evaluate_nodes();
-        // std::cout << evaluating << ", " << nn_cache.size() << '\n';
-        evaluating = false;
-        evaluating_cv.notify_all();
-        request.unlock();
-    }
-    else {
-        request.unlock();
-    }
-}
-
-// Processes the neural network evaluations for the nodes in the batch, updating them with the results.
-void Search::evaluate_nodes() {
-    auto evaluation = model::evaluate(nn_cache, nnet, device);
-    nn_evaluations = evaluation;
-    threadManager.threadEvaluation();
-}
-
-// Retrieves a neural network evaluation result for a specific node.
-std::pair<std::pair<torch::Tensor, torch::Tensor>, Node*> Search::get_evaluation() {
-    std::unique_lock<std::mutex> eval(eval_guard);
-    auto node = nn_address_cache.front();
-    auto evaluation_tensor = nn_evaluations.front();
-
-    nn_address_cache.pop();
-    nn_cache.pop();
-    nn_evaluations.pop();
-
-    return std::make_pair(evaluation_tensor, node);
-}
-
 std::string Search::getTopLine() {
     auto sel = rootNode;
+    auto board = rootState;
     std::string topLine = "";
     int i = 1;
-    if (sel->state.sideToMove() == chess::Color::BLACK) {
+    if (board.sideToMove() == chess::Color::BLACK) {
         topLine += "1... ";
         ++i;
     }
-    while (!sel->children.empty()) {
+    while (!sel->is_leaf_node()) {
+        Node* best = nullptr;
         float highest_val = -std::numeric_limits<float>::infinity();
-        for (const auto& child : sel->children) {
-            float child_val = child->visits;
+        const uint16_t num_edges = sel->edgeCount();
+        for (uint16_t e = 0; e < num_edges; ++e) {
+            Node* child = sel->edges[e].child.load(std::memory_order_acquire);
+            if (child == nullptr) continue;
+            float child_val = child->getVisits();
             if (child_val > highest_val) {
                 highest_val = child_val;
-                sel = child;
+                best = child;
             }
         }
-        if (sel->state.sideToMove() == chess::Color::BLACK) {
+        if (best == nullptr) break;
+        sel = best;
+        const auto san = chess::uci::moveToSan(board, sel->move);
+        board.makeMove(sel->move);
+        if (board.sideToMove() == chess::Color::BLACK) {
             topLine += std::to_string(i) + ". ";
             ++i;
         }
-        topLine += chess::uci::moveToSan(sel->getParent()->state, sel->move) + " ";
+        topLine += san + " ";
     }
     
     return topLine;
@@ -289,97 +277,68 @@ std::string Search::getTopLine() {
 
 // Enqueues a search task for execution by the thread pool. This method is part of the ThreadManager nested class, which manages concurrent search tasks.
 void Search::ThreadManager::workerSearch() {
-    Node* selection = nullptr;
-    auto node = search.rootNode;
-    
-    search.rootNode->visits.fetch_add(1, std::memory_order_relaxed);
-
-    // For internal nodes, select the best child based on a score and recursively expand it
-    float highest_puct = -std::numeric_limits<float>::infinity();
-    for (const auto& child : node->children) {
-        float child_val = child->puct_value();
-        if (child_val > highest_puct) {
-            highest_puct = child_val;
-            selection = child;
-        }
+    // each thread keeps one board at the root position and replays the selected path on it
+    struct ThreadBoard {
+        uint64_t root_id = UINT64_MAX;
+        chess::Board board;
+    };
+    thread_local ThreadBoard local;
+    if (local.root_id != search.root_id) {
+        local.board = search.rootState;
+        local.root_id = search.root_id;
     }
 
-    // Ensure a proper selection and avoid bottlenecks
-    if (selection == nullptr) {
-        search.nn_eval_request(1);
-        for (const auto& child : node->children) {
-            float child_val = child->puct_value();
-            if (child_val > highest_puct) {
-                highest_puct = child_val;
-                selection = child;
-            }
+    // a playout that collides with a pending evaluation is retried until it completes, so every task
+    // sent counts as one visit, the collided path now has fewer visits in flight
+    for (int attempt = 0; ; ++attempt) {
+        const uint64_t seen = search.inference->completedBatches();
+        Node* selection = search.selectChild(search.rootNode, local.board);
+        local.board.makeMove(selection->move);
+        const bool completed = search.expand(selection, local.board); // Recursively expand the selected node
+        local.board.unmakeMove(selection->move);
+        if (completed) {
+            search.rootNode->addVisit();
+            return;
         }
-        if (selection == nullptr) {
-            selection = node->children.front(); // safe selection set, helps avoid bugs especially in positions with few moves
+        // a repeated collision means the frontier is pending, flush the partial batch and wait for results
+        if (attempt > 0) {
+            search.inference->flush();
+            search.inference->waitForBatch(seen);
         }
     }
-    selection->virtual_loss = true;
-    search.expand(selection); // Recursively expand the selected node
 }
 
 // Evaluates the root node with the option to apply Dirichlet noise. This is part of the initialization phase of the search.
-void Search::ThreadManager::evaluateRoot(const bool noise) {
-    auto eval = search.get_evaluation();
-
-    auto node = eval.second;
-    auto policy_tensor = eval.first.first;
-
-    std::vector<float> policy(search.policySize);
-    policy_tensor = policy_tensor.to(torch::kFloat32).contiguous();
-    std::memcpy(policy.data(), policy_tensor.data_ptr<float>(), search.policySize * sizeof(float));
+void Search::ThreadManager::evaluateRoot(const float* priors, const float value_output, const EvalRequest& request, const bool noise) {
+    auto node = request.node;
 
-    auto move_map = policy_map::policy_to_moves(policy, node->state);
-    move_map = noise ? applyDirichletNoise(move_map, root_dirichlet_alpha, root_dirichlet_epsilon) : move_map;
-    auto nn_eval = std::make_pair(move_map, -eval.first.second.item<float>());
-    auto movelist = search.get_moves(node->state);
-    for (const auto &move : movelist) {
-        node->expand(move, move_map[move], search.container);
+    std::unordered_map<chess::Move, float> move_map;
+    for (uint16_t i = 0; i < node->num_moves; ++i) {
+        move_map[node->edges[i].move] = priors[i];
     }
-    search.transposition_table.addHash(node->state.hash(), nn_eval);
+    auto value = -value_output;
+    // cache the raw priors, noise only applies to this search's root
+    search.transposition_table.addHash(request.hash, CompactEval(move_map, value));
+    move_map = noise ? applyDirichletNoise(move_map, root_dirichlet_alpha, root_dirichlet_epsilon) : move_map;
+    node->expand([&move_map](const chess::Move move) { return move_map[move]; });
 }
 
-// Evaluates a node using the results from a neural network prediction. This method updates the node's information based on the evaluation.
-void Search::ThreadManager::evaluate() {
+// Evaluates a node using the results from a neural network prediction. Runs on the inference stage's dispatch threads.
+// @param priors: the node's legal move priors in edge order, softmaxed by the model call
+void Search::ThreadManager::evaluate(const float* priors, const float value_output, const EvalRequest& request) {
     // std::cout << "s_eval\n";
-    auto eval = search.get_evaluation();
+    auto node = request.node;
 
-    auto node = eval.second;
-    auto policy_tensor = eval.first.first;
-
-    std::vector<float> policy(search.policySize);
-    policy_tensor = policy_tensor.to(torch::kFloat32).contiguous();
-    std::memcpy(policy.data(), policy_tensor.data_ptr<float>(), search.policySize * sizeof(float));
-    auto move_map = policy_map::policy_to_moves(policy, node->state);
-    auto nn_eval = std::make_pair(move_map, -eval.first.second.item<float>());
-    auto movelist = search.get_moves(node->state);
+    auto value = -value_output;
     // std::cout << "mid_eval\n";
-    for (const auto &move : movelist) {
-        node->expand(move, move_map[move], search.container);
-    }
+    node->expandPriors(priors);
     // std::cout << "end_eval\n";
-    node->in_nnet.store(false);
-    node->nnet_cv.notify_all();
-    // std::cout << "Thread " << std::this_thread::get_id() << " notified all!\n";
-    node->backpropagate(nn_eval.second, search.container);
-    search.transposition_table.addHash(node->state.hash(), nn_eval);
-}
-
-// Handles the concurrent evaluation of nodes in the neural network evaluation queue.
-void Search::ThreadManager::threadEvaluation() {
-    ThreadPool pool(search.num_threads);
-    for (unsigned int i = 0; i < search.nn_evaluations.size(); ++i) {
-        pool.enqueueTask([this] { this->evaluate(); });
-    }
+    node->backpropagate(value, search.container);
+    search.transposition_table.addHash(request.hash, CompactEval(node->edges.get(), node->num_moves, value));
 }
 
 // Starts the search process, distributing tasks across a thread pool to explore different moves and positions concurrently.
 void Search::ThreadManager::startSearch(const bool dirichelet_noise, bool use_time, std::chrono::duration<int> const& max_time) {
-    ThreadPool pool(search.num_threads);
     auto num_sims = search.num_simulations;
     auto sent_searches = 0;
     if (dirichelet_noise) {
@@ -390,19 +349,37 @@ void Search::ThreadManager::startSearch(const bool dirichelet_noise, bool use_ti
         search.expandRoot(search.rootNode, false);
         num_sims--;
     }
-    if (!use_time) {
-        while(sent_searches < num_sims) {
-            ++sent_searches;
-            pool.enqueueTask([this] { this->workerSearch(); });
-        }
+    // the stage, its threads and batch buffers are made by the first search and kept for the rest of the game
+    if (search.inference == nullptr) {
+        search.inference = std::make_unique<InferenceStage>(search.executors, search.nn_batch_size,
+            EncodedState::planeCount(search.position_history), search.policySize, packed_input != 0, search.num_threads,
+            [this](const float* policy, const float value, const EvalRequest& request) { this->evaluate(policy, value, request); },
+            BatchingProfile::named(batching_profile), search.model_latency);
     }
-    else {
-        pool.stopAfter(max_time, search.rootNode);
-        while(!pool.shouldStop()) {
-            if (pool.get_size() < num_sims) {
+    // the pool joins its workers when it goes out of scope, the inference stage is drained after them
+    {
+        ThreadPool pool(search.num_threads);
+        if (!use_time) {
+            // visits carried over from the previous move count toward the simulation budget
+            sent_searches = std::min<int>(search.reused_visits, num_sims);
+            while(sent_searches < num_sims) {
                 ++sent_searches;
                 pool.enqueueTask([this] { this->workerSearch(); });
             }
         }
+        else {
+            pool.stopAfter(max_time, search.rootNode);
+            while(!pool.shouldStop()) {
+                if (pool.get_size() < num_sims) {
+                    ++sent_searches;
+                    pool.enqueueTask([this] { this->workerSearch(); });
+                }
+            }
+        }
     }
+    search.inference->finish();
+    search.model_latency = search.inference->latency();
+    search.inference_stats = search.inference->takeStats();
+    // the workers are gone, their partly filled slabs are recycled once the tree lets go of their nodes
+    search.container.closeSlabs();
 }
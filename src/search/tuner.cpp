@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include "include/search/tuner.hpp"
+#include "include/model/executor.hpp"
+
+namespace {
+    // @return The q quantile of sorted samples by nearest rank, 0 without samples
+    std::chrono::microseconds percentile(const std::vector<std::chrono::microseconds>& sorted, const double q) {
+        if (sorted.empty()) return std::chrono::microseconds(0);
+        const auto rank = static_cast<size_t>(std::ceil(q * static_cast<double>(sorted.size())));
+        return sorted[std::clamp<size_t>(rank, 1, sorted.size()) - 1];
+    }
+
+    // @return 1, 2, 4, ... up to limit, with limit itself last
+    std::vector<unsigned int> doublings(const unsigned int limit) {
+        std::vector<unsigned int> counts;
+        for (unsigned int count = 1; count < limit; count *= 2) counts.push_back(count);
+        counts.push_back(std::max(limit, 1u));
+        return counts;
+    }
+
+    void print(const TuningResult& result) {
+        std::cout << std::setw(6) << result.batch_size << std::setw(9) << result.search_threads << std::setw(11) << result.inference_executors
+                  << std::setw(12) << std::fixed << std::setprecision(0) << result.evals_per_second
+                  << std::setw(11) << result.simulations_per_second
+                  << std::setw(10) << result.p50_latency.count() << std::setw(10) << result.p99_latency.count() << '\n';
+    }
+}
+
+TuningGrid TuningGrid::forHost() {
+    const unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+    TuningGrid grid;
+    grid.search_threads = doublings(cores);
+    // executors beyond a quarter of the cores only compete with the search threads for them
+    grid.inference_executors = doublings(std::clamp(cores / 4, 1u, 4u));
+    return grid;
+}
+
+/*
+    @param positions: fens searched by every combination
+    @param simulations: playouts of each search
+*/
+Tuner::Tuner(const model::Evaluator& evaluator, const std::vector<std::string>& positions, unsigned int simulations)
+    : evaluator(evaluator), positions(positions), simulations(simulations) {}
+
+/*
+    Measures every combination of a grid, printing each as it finishes
+    @return The results, fastest first
+*/
+std::vector<TuningResult> Tuner::run(const TuningGrid& grid) {
+    const int configured_executors = inference_executors;
+    // the first searches pay for allocation and the model's warm up, they are not measured
+    measure(grid.batch_sizes.front(), grid.search_threads.front(), grid.inference_executors.front());
+
+    std::cout << " batch  threads  executors     evals/s     sims/s   p50(us)   p99(us)\n";
+    results.clear();
+    for (const unsigned int executors : grid.inference_executors) {
+        for (const unsigned int threads : grid.search_threads) {
+            for (const unsigned int batch_size : grid.batch_sizes) {
+                results.push_back(measure(batch_size, threads, executors));
+                print(results.back());
+            }
+        }
+    }
+    inference_executors = configured_executors;
+    model::releaseExecutors(evaluator);
+
+    std::sort(results.begin(), results.end(), [](const TuningResult& a, const TuningResult& b) {
+        return a.simulations_per_second > b.simulations_per_second;
+    });
+    return results;
+}
+
+// Searches every tuning position once with one combination.
+TuningResult Tuner::measure(unsigned int batch_size, unsigned int search_threads, unsigned int executors) {
+    // the executor pool is made when the first search of the evaluator starts, with the global settings
+    model::releaseExecutors(evaluator);
+    inference_executors = static_cast<int>(executors);
+
+    TuningResult result{batch_size, search_threads, executors};
+    std::vector<std::chrono::microseconds> latencies;
+    uint64_t positions_evaluated = 0;
+    uint64_t visits = 0;
+    std::chrono::duration<double> elapsed(0);
+    for (const auto& fen : positions) {
+        EvalTable transposition_table;
+        transposition_table.set_size(transposition_table_size);
+        std::vector<chess::Board> traversed;
+        Container container;
+        Search search(container.create(0), chess::Board(fen), container, traversed, transposition_table, evaluator, simulations, search_threads, batch_size);
+
+        const auto start = std::chrono::steady_clock::now();
+        search.startSearch(false);
+        elapsed += std::chrono::steady_clock::now() - start;
+
+        visits += static_cast<uint64_t>(search.rootNode->getVisits());
+        positions_evaluated += search.inference_stats.positions;
+        latencies.insert(latencies.end(), search.inference_stats.batch_latencies.begin(), search.inference_stats.batch_latencies.end());
+    }
+
+    const double seconds = std::max(elapsed.count(), 1e-9);
+    result.evals_per_second = static_cast<double>(positions_evaluated) / seconds;
+    result.simulations_per_second = static_cast<double>(visits) / seconds;
+    std::sort(latencies.begin(), latencies.end());
+    result.p50_latency = percentile(latencies, 0.50);
+    result.p99_latency = percentile(latencies, 0.99);
+    return result;
+}
+
+// Uses a result for the rest of this run, searches created from now on pick it up.
+void Tuner::apply(const TuningResult& result) const {
+    nn_batch_size = static_cast<int>(result.batch_size);
+    search_threads = static_cast<int>(result.search_threads);
+    inference_executors = static_cast<int>(result.inference_executors);
+    model::releaseExecutors(evaluator);
+}
+
+/*
+    Writes a result as a profile in the format of params.txt, which later runs load over it, with
+    every measured combination as comments
+    @return false if the file cannot be written
+*/
+bool Tuner::save(const TuningResult& result, const std::string& path) const {
+    std::ofstream file(path);
+    if (!file) return false;
+    file << "# tuned with inference_backend=" << inference_backend << ", inference_precision=" << inference_precision
+         << ", " << simulations << " simulations on each of " << positions.size() << " positions\n";
+    file << "# batch threads executors evals/s sims/s p50(us) p99(us)\n";
+    for (const auto& measured : results) {
+        file << "# " << measured.batch_size << ' ' << measured.search_threads << ' ' << measured.inference_executors << ' '
+             << std::fixed << std::setprecision(0) << measured.evals_per_second << ' ' << measured.simulations_per_second << ' '
+             << measured.p50_latency.count() << ' ' << measured.p99_latency.count() << '\n';
+    }
+    file << "nn_batch_size=" << result.batch_size << '\n';
+    file << "search_threads=" << result.search_threads << '\n';
+    file << "inference_executors=" << result.inference_executors << '\n';
+    return static_cast<bool>(file);
+}
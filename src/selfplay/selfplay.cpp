@@ -25,9 +25,9 @@ std::string formatTime(int total_seconds) {
     return oss.str();
 }
 
-SelfPlay::SelfPlay(int total_games, int sims_per_move, unsigned int threads, float resign_threshold, int nn_cache_size, bool trust_val, torch::jit::script::Module& nnet, torch::Device device, size_t ttable_size, float temperature_start) :
+SelfPlay::SelfPlay(int total_games, int sims_per_move, unsigned int threads, float resign_threshold, int nn_cache_size, bool trust_val, const model::Evaluator& evaluator, size_t ttable_size, float temperature_start) :
                     total_games(total_games), sims_per_move(sims_per_move), threads(threads), resign_threshold(resign_threshold), nn_cache_size(nn_cache_size), trust_val(trust_val),
-                    nnet(nnet), device(device), ttable_size(ttable_size), temperature_start(temperature_start) {transposition_table.set_size(ttable_size);}
+                    evaluator(evaluator), ttable_size(ttable_size), temperature_start(temperature_start) {transposition_table.set_size(ttable_size);}
 
 void SelfPlay::run() {
     ThreadPool pool(threads);
@@ -89,19 +89,19 @@ void SelfPlay::selfPlayGame() {
     std::ofstream PolicyLabels(directoryPath + "/policy.bin", std::ios::binary | std::ios::app);
     std::ofstream ValueLabels(directoryPath + "/q_values.bin", std::ios::binary | std::ios::app);
 
-    uint8_t progress = 0;
     std::string thread_id = std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
     game_info[thread_id] = "Game #" + std::to_string(index) + ", Move: " + std::to_string(1) + ", RT: " + std::to_string(res_threshold);
     
+    // one search for the whole game, the subtree under each played move carries over to the next search
+    Container container;
+    auto rootNode = container.create(0);
+    auto newSearch = Search(rootNode, startState, container, traversed, transposition_table, evaluator, 
+                        sims_per_move, 1, nn_cache_size, false);
     for (int turns = 0; turns < 256; ++turns) {
-        game_info[thread_id] = "Game #" + std::to_string(index) + ", Move: " + std::to_string(turns+1) + ", RT: " + std::to_string(res_threshold);
-        Container container;
-        auto rootNode = new Node(container, startState, progress);
-        auto newSearch = Search(rootNode, container, traversed, transposition_table, nnet, device, 
-                            sims_per_move, 1, nn_cache_size, false);
         if (turns == 30) {temperature = temperature_end;}
         newSearch.startSearch(true);
-        auto move_map = get_move_map(rootNode, trust_val);
+        game_info[thread_id] = "Game #" + std::to_string(index) + ", Move: " + std::to_string(turns+1) + ", RT: " + std::to_string(res_threshold) + ", Reused: " + std::to_string(newSearch.reused_visits);
+        auto move_map = get_move_map(newSearch.rootNode, trust_val);
         valueBuffer.emplace_back(newSearch.getRootQ());
         // // for debugging
         // for (const auto& move : move_map) {
@@ -113,7 +113,6 @@ void SelfPlay::selfPlayGame() {
         }
         auto move = newSearch.selectMove(false, temperature, res_threshold);
         num_moves.fetch_add(1, std::memory_order_relaxed);
-        progress = newSearch.rootNode->moves_since_cpm;
         
         if (move.second != -1) {
             if (move.second != 1 && startState.sideToMove() == chess::Color::BLACK) {
@@ -175,15 +174,24 @@ void SelfPlay::selfPlayGame() {
 
 std::unordered_map<chess::Move, float> SelfPlay::get_move_map(const Node* root, bool trust_val) {
     std::unordered_map<chess::Move, float> move_map;
+    const uint16_t num_edges = root->edgeCount();
     if (trust_val) {
-        for (const auto& child : root->children) {
-            move_map.insert({child->move, static_cast<float>(child->visits)/static_cast<float>(sims_per_move)});
+        // a reused root can hold more visits than one search adds, so normalize by what the children hold
+        int total_visits = 0;
+        for (uint16_t i = 0; i < num_edges; ++i) {
+            const Node* child = root->edges[i].child.load(std::memory_order_acquire);
+            const int visits = child != nullptr ? child->getVisits() : 0;
+            total_visits += visits;
+            move_map.insert({root->edges[i].move, static_cast<float>(visits)});
+        }
+        for (auto& move : move_map) {
+            move.second /= static_cast<float>(std::max(total_visits, 1));
         }
         return move_map;
     }
     else {
-        for (const auto& child : root->children) {
-            move_map.insert({child->move, child->policy});
+        for (uint16_t i = 0; i < num_edges; ++i) {
+            move_map.insert({root->edges[i].move, root->edges[i].policy});
         }
         return move_map;
     }